@@ -301,35 +301,8 @@ public:
 
     void writeb(uint16_t addr, uint8_t val) { memory[addr] = val; }
 
-    template <typename It>
-    void print(It begin, It end) {
-        if (begin == end) cout << "[]" << endl;
-        cout << "[" << setw(3) << (int) *begin;
-        while (++begin != end) {
-            cout << "," << setw(3) << (int) *begin;
-        }
-        cout << "]";
-    }
-
-    void print_state(uint16_t instr) {
-        cout << hex;
-        cout << setw(13) << "stack: "; 
-        print(begin(stack), begin(stack) + reg.sp); cout << endl;
-        cout << setw(13) << "registers: " << endl;
-        for (int i = 0; i < 16; ++i) {
-            cout << setw(17) << "v" << i << " = " << (int) reg.g[i] << endl;
-        }
-        cout << setw(18) << "I " << " = " << (int) reg.i << endl;
-        cout << setw(18) << "dt" << " = " << (int) reg.dt << endl;
-        cout << setw(18) << "st" << " = " << (int) reg.st << endl;
-        cout << setw(18) << "pc" << " = " << (int) reg.pc << endl;
-        cout << endl;
-        cout << dec;
-    }
-    
     void exec_instruction() {
         uint16_t instr = readw(reg.pc);
-        print_state(instr);
         switch (instr & 0xf000) {
             case 0x0000:
                 if (instr == 0x00e0) { // 00E0 - CLS
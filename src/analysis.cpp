@@ -0,0 +1,129 @@
+#include "analysis.h"
+#include "machine.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+bool skips(op_t op) {
+    switch (op) {
+    case op_se_byte: case op_sne_byte: case op_se_reg: case op_sne_reg:
+    case op_skp: case op_sknp:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Whether control goes anywhere but to the next instruction.
+bool branches(op_t op) {
+    return skips(op) || op == op_jp || op == op_ret || op == op_jp_v0;
+}
+
+} // namespace
+
+analysis_t::analysis_t(const string & program) {
+    const uint16_t start = machine_t::PROGRAM_START_ADDRESS;
+    kinds.fill(unknown);
+    array<uint8_t, 4096> bytes;
+    bytes.fill(0);
+    copy_n(program.begin(), min<size_t>(program.size(), 4096 - start),
+           bytes.begin() + start);
+    auto word = [&bytes](uint16_t addr) -> uint16_t {
+        return (bytes[addr & 0xfff] << 8) | bytes[(addr + 1) & 0xfff];
+    };
+
+    // follow control flow, remembering which subroutine got where first
+    set<uint16_t> leaders = { start };
+    vector<pair<uint16_t, uint16_t>> pending = { { start, start } };
+    calls[start];
+    while (!pending.empty()) {
+        uint16_t addr = pending.back().first;
+        uint16_t entry = pending.back().second;
+        pending.pop_back();
+        while (addr < 4095 && !starts[addr]) {
+            uint16_t in = word(addr);
+            op_t op = decode(in);
+            if (op == op_unknown) break;
+            starts[addr] = true;
+            kinds[addr] = kinds[addr + 1] = code;
+            uint16_t nnn = in & 0x0fff;
+            if (op == op_call) {
+                calls[entry].insert(nnn);
+                calls[nnn];
+                leaders.insert(nnn);
+                pending.push_back({ nnn, nnn });
+            } else if (op == op_jp) {
+                leaders.insert(nnn);
+                pending.push_back({ nnn, entry });
+                break;
+            } else if (op == op_jp_v0) {
+                computed_jumps.push_back(addr);
+                break;
+            } else if (op == op_ret) {
+                break;
+            } else if (skips(op)) {
+                leaders.insert(addr + 2);
+                leaders.insert(addr + 4);
+                pending.push_back({ addr + 4, entry });
+            }
+            addr += 2;
+        }
+        // a jump into an instruction already seen splits its block
+        if (addr < 4095 && starts[addr]) leaders.insert(addr);
+    }
+
+    // cut the decoded instructions into blocks
+    for (int addr = 0; addr < 4096; ++addr) {
+        if (!starts[addr] || !leaders.count(addr)) continue;
+        block_t b = { uint16_t(addr), uint16_t(addr), {} };
+        while (true) {
+            uint16_t in = word(b.end);
+            op_t op = decode(in);
+            b.end += 2;
+            if (op == op_jp) b.next.push_back(in & 0x0fff);
+            if (skips(op)) b.next.push_back(b.end + 2);
+            if (!branches(op)) {
+                if (b.end >= 4095 || !starts[b.end]) break;
+                if (leaders.count(b.end)) {
+                    b.next.push_back(b.end);
+                    break;
+                }
+                continue;
+            }
+            if (skips(op)) b.next.push_back(b.end);
+            break;
+        }
+        blocks[addr] = b;
+    }
+
+    // I is only known from an Annn earlier in the same block
+    for (auto & entry : blocks) {
+        const block_t & b = entry.second;
+        int i = -1;
+        for (uint16_t addr = b.start; addr < b.end; addr += 2) {
+            uint16_t in = word(addr);
+            uint8_t x = (in >> 8) & 0x000f;
+            int length = 0;
+            bool store = false;
+            switch (decode(in)) {
+            case op_ld_i: i = in & 0x0fff; break;
+            case op_add_i: case op_ld_f: i = -1; break;
+            case op_drw: length = in & 0x000f; break;
+            // V0..Vx-1, as the interpreter does it
+            case op_ld_vx_mem: length = x; break;
+            case op_ld_mem_vx: length = x; store = true; break;
+            case op_ld_b: length = 3; store = true; break;
+            default: break;
+            }
+            if (i < 0) continue;
+            bool overwrites = false;
+            for (int k = i; k < i + length && k < 4096; ++k) {
+                overwrites |= kinds[k] == code;
+                if (kinds[k] == unknown) kinds[k] = data;
+            }
+            if (store && overwrites) code_writes.push_back(addr);
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/*
+    What can be told about a program without running it. Control flow is
+    followed from 0x200 through jumps, calls, skips and returns, assuming
+    every call returns. What that reaches is code; what instructions point
+    I at before drawing, loading or storing is data. Bnnn jumps can't be
+    followed and are only listed, so code reached through them stays
+    unknown, as does anything else never reached.
+*/
+class analysis_t {
+public:
+
+    enum kind_t : uint8_t { unknown, code, data };
+
+    struct block_t {
+        uint16_t start;
+        // past the last instruction
+        uint16_t end;
+        // where control goes from the last instruction, calls excluded
+        std::vector<uint16_t> next;
+    };
+
+    // Byte by byte. A byte that is both is code.
+    std::array<kind_t, 4096> kinds;
+    // Addresses instructions were decoded at.
+    std::bitset<4096> starts;
+    std::map<uint16_t, block_t> blocks;
+    // Entry of every subroutine, 0x200 included, to the ones it calls.
+    std::map<uint16_t, std::set<uint16_t>> calls;
+    // Bnnn instructions.
+    std::vector<uint16_t> computed_jumps;
+    // Fx33 and Fx55 instructions storing over code.
+    std::vector<uint16_t> code_writes;
+
+    analysis_t(const std::string & program);
+
+};
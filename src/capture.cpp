@@ -0,0 +1,401 @@
+#include "capture.h"
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+class capture_t::encoder_t {
+public:
+    virtual ~encoder_t() { }
+    virtual void write(const chip8::frame_t & frame, unsigned repeat) = 0;
+    virtual void finish() { }
+};
+
+namespace {
+
+const int WIDTH = 64;
+const int HEIGHT = 32;
+
+// same grey as the window uses for lit pixels
+const uint8_t LIT = 204;
+
+bool pixel(const chip8::frame_t & frame, int x, int y) {
+    return (frame[y] >> (WIDTH - 1 - x)) & 1;
+}
+
+struct io_exception : runtime_error {
+    io_exception(const string & path)
+            : runtime_error("can't write capture file: " + path) { }
+};
+
+ofstream open(const string & path) {
+    ofstream out(path, ios_base::out | ios_base::binary);
+    if (!out) throw io_exception(path);
+    return out;
+}
+
+// A stream that went bad, a full disk say, is an error and not a short file.
+void check_stream(ostream & out, const string & path) {
+    if (!out) throw io_exception(path);
+}
+
+struct grey_encoder_t : capture_t::encoder_t {
+    string path;
+    ofstream out;
+    unsigned scale;
+    bool y4m;
+    vector<uint8_t> buffer;
+
+    grey_encoder_t(const string & path, unsigned fps_num, unsigned fps_den,
+                   unsigned scale, bool y4m)
+            : path(path), out(open(path)), scale(scale), y4m(y4m)
+            , buffer(WIDTH * HEIGHT * scale * scale) {
+        if (y4m)
+            out << "YUV4MPEG2 W" << WIDTH * scale << " H" << HEIGHT * scale
+                << " F" << fps_num << ":" << fps_den << " Ip A1:1 Cmono\n";
+    }
+
+    void write(const chip8::frame_t & frame, unsigned repeat) override {
+        auto p = buffer.begin();
+        for (int y = 0; y < HEIGHT; ++y)
+            for (unsigned r = 0; r < scale; ++r)
+                for (int x = 0; x < WIDTH; ++x)
+                    p = fill_n(p, scale, pixel(frame, x, y) ? LIT : 0);
+        for (unsigned k = 0; k < repeat; ++k) {
+            if (y4m) out << "FRAME\n";
+            out.write((const char *) buffer.data(), buffer.size());
+        }
+        check_stream(out, path);
+    }
+
+    void finish() override {
+        out.flush();
+        check_stream(out, path);
+    }
+};
+
+// Writes big-endian words and chunk checksums shared by the PNG encoder.
+struct png_chunk_t {
+    string data;
+
+    static uint32_t crc(const string & s, uint32_t c = 0xffffffff) {
+        static array<uint32_t, 256> table = [] {
+            array<uint32_t, 256> t;
+            for (uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+                t[n] = c;
+            }
+            return t;
+        }();
+        for (unsigned char b : s)
+            c = table[(c ^ b) & 0xff] ^ (c >> 8);
+        return c;
+    }
+
+    png_chunk_t(const char * type) : data(type) { }
+
+    png_chunk_t & u8(uint8_t b) { data += (char) b; return *this; }
+
+    png_chunk_t & u32(uint32_t w) {
+        return u8(w >> 24).u8(w >> 16).u8(w >> 8).u8(w);
+    }
+
+    void write(ostream & out) {
+        uint32_t length = data.size() - 4;
+        uint32_t sum = crc(data) ^ 0xffffffff;
+        for (int s = 24; s >= 0; s -= 8) out.put(length >> s);
+        out << data;
+        for (int s = 24; s >= 0; s -= 8) out.put(sum >> s);
+    }
+};
+
+// One-bit palette images, zlib stream made of stored blocks. Frames are tiny
+// and PNG is only meant for inspection, so deflate isn't worth it here.
+struct png_encoder_t : capture_t::encoder_t {
+    string stem;
+    unsigned scale;
+    unsigned index;
+
+    png_encoder_t(const string & path, unsigned scale)
+            : stem(path.substr(0, path.size() - 4)), scale(scale), index(0) {
+        open(name()); // fail early on a bad directory
+    }
+
+    string name() const {
+        string number = to_string(index);
+        return stem + "_" + string(6 - min<size_t>(6, number.size()), '0')
+             + number + ".png";
+    }
+
+    void write(const chip8::frame_t & frame, unsigned repeat) override {
+        const uint32_t w = WIDTH * scale, h = HEIGHT * scale;
+        const uint32_t stride = (w + 7) / 8;
+        string raw;
+        raw.reserve((stride + 1) * h);
+        for (int y = 0; y < HEIGHT; ++y) {
+            string row(stride, 0);
+            for (uint32_t i = 0; i < w; ++i)
+                if (pixel(frame, i / scale, y))
+                    row[i / 8] |= 0x80 >> (i % 8);
+            for (unsigned r = 0; r < scale; ++r)
+                raw += '\0' + row;
+        }
+        ofstream out = open(name());
+        out << "\x89PNG\r\n\x1a\n";
+        png_chunk_t("IHDR").u32(w).u32(h).u8(1).u8(3).u8(0).u8(0).u8(0)
+                           .write(out);
+        png_chunk_t("PLTE").u8(0).u8(0).u8(0).u8(LIT).u8(LIT).u8(LIT)
+                           .write(out);
+        png_chunk_t idat("IDAT");
+        idat.u8(0x78).u8(0x01);
+        uint32_t a = 1, b = 0;
+        for (size_t pos = 0; pos < raw.size(); pos += 0xffff) {
+            size_t len = min<size_t>(0xffff, raw.size() - pos);
+            idat.u8(pos + len == raw.size())
+                .u8(len).u8(len >> 8).u8(~len).u8(~len >> 8);
+            idat.data.append(raw, pos, len);
+        }
+        for (unsigned char c : raw) {
+            a = (a + c) % 65521;
+            b = (b + a) % 65521;
+        }
+        idat.u32((b << 16) | a).write(out);
+        png_chunk_t("IEND").write(out);
+        out.close();
+        check_stream(out, name());
+        index += repeat;
+    }
+};
+
+struct gif_encoder_t : capture_t::encoder_t {
+    static const int MIN_CODE_SIZE = 2;
+    static const uint16_t CLEAR = 1 << MIN_CODE_SIZE;
+    static const uint16_t END = CLEAR + 1;
+
+    string path;
+    ofstream out;
+    unsigned fps_num, fps_den;
+    unsigned scale;
+    uint64_t frames;
+    string block;
+    uint32_t bits;
+    int nbits;
+
+    gif_encoder_t(const string & path, unsigned fps_num, unsigned fps_den,
+                  unsigned scale)
+            : path(path), out(open(path)), fps_num(fps_num), fps_den(fps_den)
+            , scale(scale), frames(0) {
+        const uint16_t w = WIDTH * scale, h = HEIGHT * scale;
+        out << "GIF89a";
+        put16(w); put16(h);
+        out.put(0x80); // global colour table of two entries
+        out.put(0); out.put(0);
+        out.put(0); out.put(0); out.put(0);
+        out.put(LIT); out.put(LIT); out.put(LIT);
+        // loop forever
+        out << "\x21\xff\x0bNETSCAPE2.0\x03\x01";
+        put16(0); out.put(0);
+    }
+
+    void put16(uint16_t w) { out.put(w & 0xff); out.put(w >> 8); }
+
+    void code(uint16_t c, int size) {
+        bits |= uint32_t(c) << nbits;
+        nbits += size;
+        while (nbits >= 8) {
+            block += (char) (bits & 0xff);
+            bits >>= 8;
+            nbits -= 8;
+            if (block.size() == 255) flush();
+        }
+    }
+
+    void flush() {
+        if (block.empty()) return;
+        out.put(block.size());
+        out << block;
+        block.clear();
+    }
+
+    void write(const chip8::frame_t & frame, unsigned repeat) override {
+        // delays are in hundredths of a second, carry the rounding over
+        uint64_t from = frames * 100 * fps_den / fps_num;
+        frames += repeat;
+        uint64_t to = frames * 100 * fps_den / fps_num;
+        uint16_t delay = min<uint64_t>(to - from, 0xffff);
+
+        out << "\x21\xf9\x04";
+        out.put(0);
+        put16(delay);
+        out.put(0); out.put(0);
+
+        out.put(0x2c);
+        put16(0); put16(0);
+        put16(WIDTH * scale); put16(HEIGHT * scale);
+        out.put(0);
+        out.put(MIN_CODE_SIZE);
+
+        // LZW over a prefix tree, two children per node for two colours
+        vector<array<uint16_t, 2>> tree(4096, {{ 0, 0 }});
+        int size = MIN_CODE_SIZE + 1;
+        uint16_t max_code = END;
+        int current = -1;
+        bits = 0;
+        nbits = 0;
+        code(CLEAR, size);
+        for (unsigned y = 0; y < HEIGHT * scale; ++y)
+            for (unsigned x = 0; x < WIDTH * scale; ++x) {
+                int value = pixel(frame, x / scale, y / scale);
+                if (current < 0) {
+                    current = value;
+                } else if (tree[current][value]) {
+                    current = tree[current][value];
+                } else {
+                    code(current, size);
+                    tree[current][value] = ++max_code;
+                    if (max_code >= (1u << size)) ++size;
+                    if (max_code == 4095) {
+                        code(CLEAR, size);
+                        fill(tree.begin(), tree.end(),
+                             array<uint16_t, 2>{{ 0, 0 }});
+                        size = MIN_CODE_SIZE + 1;
+                        max_code = END;
+                    }
+                    current = value;
+                }
+            }
+        code(current, size);
+        code(END, size);
+        if (nbits) code(0, 8 - nbits);
+        flush();
+        out.put(0);
+        check_stream(out, path);
+    }
+
+    void finish() override {
+        out.put(0x3b);
+        out.flush();
+        check_stream(out, path);
+    }
+};
+
+bool ends_with(const string & s, const string & suffix) {
+    return s.size() >= suffix.size()
+        && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+capture_t::encoder_t * make_encoder(const string & path, unsigned fps_num,
+                                    unsigned fps_den, unsigned scale) {
+    if (ends_with(path, ".y4m"))
+        return new grey_encoder_t(path, fps_num, fps_den, scale, true);
+    if (ends_with(path, ".raw"))
+        return new grey_encoder_t(path, fps_num, fps_den, scale, false);
+    if (ends_with(path, ".gif"))
+        return new gif_encoder_t(path, fps_num, fps_den, scale);
+    if (ends_with(path, ".png"))
+        return new png_encoder_t(path, scale);
+    throw runtime_error("unknown capture format: " + path);
+}
+
+} // namespace
+
+void capture_t::check(const string & path) {
+    delete make_encoder(path, 60, 1, 1);
+}
+
+capture_t::capture_t(const string & path,
+                     unsigned fps_num, unsigned fps_den, unsigned scale)
+        : encoder(make_encoder(path, fps_num, fps_den, scale))
+        , reported(false), done(false) {
+    worker = thread(&capture_t::run, this);
+}
+
+capture_t::~capture_t() {
+    try {
+        close();
+    } catch (const exception & e) {
+        // nobody is left to throw to
+        cerr << "error: " << e.what() << endl;
+    }
+}
+
+void capture_t::close() {
+    if (!worker.joinable()) return;
+    if (held) push(move(held));
+    {
+        lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    ready.notify_one();
+    worker.join();
+    rethrow();
+}
+
+void capture_t::rethrow() {
+    lock_guard<std::mutex> lock(mutex);
+    if (!error || reported) return;
+    reported = true;
+    rethrow_exception(error);
+}
+
+void capture_t::submit(const chip8::frame_t & frame) {
+    rethrow();
+    if (held && held->frame == frame) {
+        ++held->repeat;
+        return;
+    }
+    unique_ptr<slot_t> slot;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        if (!pool.empty()) {
+            slot = move(pool.back());
+            pool.pop_back();
+        }
+    }
+    // the pool only grows while the encoder is behind
+    if (!slot) slot.reset(new slot_t);
+    slot->frame = frame;
+    slot->repeat = 1;
+    if (held) push(move(held));
+    held = move(slot);
+}
+
+void capture_t::push(unique_ptr<slot_t> slot) {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        queue.push_back(move(slot));
+    }
+    ready.notify_one();
+}
+
+void capture_t::run() {
+    unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        ready.wait(lock, [this] { return done || !queue.empty(); });
+        if (queue.empty()) break;
+        auto slot = move(queue.front());
+        queue.pop_front();
+        // after an error frames are only given back
+        bool failed = bool(error);
+        lock.unlock();
+        exception_ptr e;
+        try {
+            if (!failed) encoder->write(slot->frame, slot->repeat);
+        } catch (...) {
+            e = current_exception();
+        }
+        lock.lock();
+        if (e) error = e;
+        pool.push_back(move(slot));
+    }
+    if (error) return;
+    try {
+        encoder->finish();
+    } catch (...) {
+        error = current_exception();
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "chip8.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    Records presented frames to a file. Frames are copied into pooled buffers
+    and encoded on a background thread, so submit() never waits for I/O.
+    Consecutive identical frames are collapsed into one buffer with a repeat
+    count. The format is chosen by the extension of the path:
+        .y4m  - YUV4MPEG2 video, Cmono
+        .raw  - headerless 8-bit grey frames
+        .gif  - animated GIF
+        .png  - sequence of PNG files named <stem>_<frame number>.png
+    A write that fails, on the background thread, is thrown once from the
+    next submit() or from close(). The destructor closes the file too, but
+    can only print the error.
+*/
+class capture_t {
+
+    struct slot_t {
+        chip8::frame_t frame;
+        unsigned repeat;
+    };
+
+public:
+
+    class encoder_t;
+
+    // Throws what the constructor would for path: an unknown extension or a
+    // file that can't be written, which it creates.
+    static void check(const std::string & path);
+
+    capture_t(const std::string & path,
+              unsigned fps_num = 60, unsigned fps_den = 1,
+              unsigned scale = 10);
+    capture_t(const capture_t & c) = delete;
+    capture_t & operator=(const capture_t & c) = delete;
+    ~capture_t();
+
+    void submit(const chip8::frame_t & frame);
+
+    // Writes out the frames still queued and finishes the file.
+    void close();
+
+private:
+
+    std::unique_ptr<encoder_t> encoder;
+    std::unique_ptr<slot_t> held;
+    std::vector<std::unique_ptr<slot_t>> pool;
+    std::deque<std::unique_ptr<slot_t>> queue;
+    std::mutex mutex;
+    std::condition_variable ready;
+    // the first failed write, and whether it was thrown yet
+    std::exception_ptr error;
+    bool reported;
+    bool done;
+    std::thread worker;
+
+    void rethrow();
+    void push(std::unique_ptr<slot_t> slot);
+    void run();
+
+};
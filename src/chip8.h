@@ -1,22 +1,129 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string>
 #include <memory>
+#include <vector>
 
 class chip8 {
 
     class impl_t;
-    impl_t * impl;
+    std::unique_ptr<impl_t> impl;
 
 public:
 
+    // 64x32 pixels, one row per word, the leftmost pixel in the highest bit
+    using frame_t = std::array<uint64_t, 32>;
+
     chip8();
     chip8(const chip8 & c) = delete;
     chip8 & operator=(const chip8 & c) = delete;
+    chip8(chip8 && c);
+    chip8 & operator=(chip8 && c);
+    ~chip8();
+
+    // A copy of the machine as it is now, under the same timing, run-ahead,
+    // speed and filter, for save states and what-ifs. Memory is shared
+    // until written, so this is cheap. Window, capture, debugger and trace
+    // stay with this one.
+    chip8 snapshot() const;
 
+    // Loads a program and resets the machine.
     void load(std::istream & source);
+
+    // Back to the state right after load(): registers, timers, screen and
+    // memory, including whatever the program wrote to itself.
+    void reset();
+
+    // Runs in a window until it is closed.
     void start();
 
+    // Stepping for hosts that drive the machine themselves. Both throw
+    // std::runtime_error on an unknown instruction, and go through the
+    // debugger and trace if attached.
+
+    // Runs n instructions, fewer if the program waits for a key. The timers
+    // count down with them: a tick every 15 instructions, or under VIP
+    // timing every frame of their cycle costs, a Dxyn waiting for the next
+    // one. Waiting for a key takes no time, only run_frame() lets it pass.
+    void run_instructions(unsigned n);
+
+    // Runs to the end of the frame, whatever run_instructions() already ran
+    // of it.
+    // Returns true while the buzzer sounds.
+    bool run_frame();
+
+    // Whether the debugger stopped execution, before the instruction at
+    // pc(); the stepping call returns there, the frame unfinished. The next
+    // one first reads debugger commands, as start() does, and runs nothing
+    // once they say to quit.
+    bool stopped() const;
+
+    // The keys held down, bit k for key k.
+    void set_keys(uint16_t keys);
+
+    // Whether Fx0A stopped the program until a key goes down.
+    bool waiting_for_key() const;
+
+    // Views into the machine, valid until it is destroyed or moved from.
+    // frame() is the screen itself, see presented() for what is shown.
+    const frame_t & frame() const;
+    const std::array<uint8_t, 16> & registers() const;
+    uint16_t index() const;
+    uint16_t pc() const;
+    uint8_t delay_timer() const;
+    uint8_t sound_timer() const;
+    uint8_t peek(uint16_t addr) const;
+
+    // Shows each frame as it will be the given number of frames later if
+    // the keys don't change, hiding the frames a program spends between
+    // reading input and drawing. Execution itself is unaffected.
+    void runahead(unsigned frames);
+
+    // The frame start() would show now: the screen, or with run-ahead the
+    // screen as it will be then.
+    frame_t presented() const;
+
+    // Records every frame start() or run_frame() presents, see
+    // capture_t for the formats. Throws std::runtime_error for an unknown
+    // extension or a path that can't be written. The file is opened by the
+    // first frame, at the frame rate of the timing then chosen, and closed
+    // when start() returns, on the next capture() or when the machine is
+    // destroyed. A write that fails later is thrown, as std::runtime_error,
+    // from the run_frame() or start() that finds it, and ends the capture.
+    // An empty path stops recording, throwing whatever closing the file
+    // found.
+    void capture(const std::string & path);
+
+    // How the window scales the screen: nearest, scanline, scale2x or
+    // scale3x, see raster_t.
+    void filter(const std::string & name);
+
+    // Times instructions by their cycle cost on the COSMAC VIP, with 60
+    // frames a second, instead of one instruction per millisecond. Has to
+    // come before anything runs, or right after reset(); throws
+    // std::logic_error otherwise.
+    void vip_timing();
+
+    // Runs factor times as fast as real time. Execution is the same at any
+    // speed, frame for frame.
+    void speed(double factor);
+
+    // Attaches the debugger, which stops before the first instruction and
+    // reads commands from the standard input; see stopped() for hosts
+    // stepping the machine themselves.
+    void debug();
+
+    // Records every executed instruction to a ring file at path, see trace_t.
+    void trace(const std::string & path);
+
 };
 
+// Mnemonic and operands of an instruction.
+std::vector<std::string> show(uint16_t in);
+
+// One line of disassembly: address, opcode, mnemonic and operands.
+void print_instruction(std::ostream & out, uint16_t addr, uint16_t in);
+
 void disassemble(std::istream & source, std::ostream & out);
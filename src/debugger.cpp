@@ -0,0 +1,156 @@
+#include "debugger.h"
+#include <cctype>
+#include <climits>
+#include <stdexcept>
+
+using namespace std;
+
+debugger_t::debugger_t()
+        : stepping(false), skip(false), over_sp(-1), over_pc(0)
+        , active(false) { }
+
+void debugger_t::update() {
+    active = stepping || skip || over_sp >= 0
+          || breakpoints.any() || conditional.any()
+          || reads.any() || writes.any();
+}
+
+void debugger_t::set_breakpoint(uint16_t addr) {
+    breakpoints.set(addr & 0x0fff);
+    update();
+}
+
+void debugger_t::set_breakpoint(uint16_t addr, const condition_t & cond) {
+    conditional.set(addr & 0x0fff);
+    conditions.emplace_back(addr & 0x0fff, cond);
+    update();
+}
+
+void debugger_t::set_watchpoint(uint16_t addr, uint16_t length,
+                                bool read, bool write) {
+    for (uint16_t k = 0; k < length; ++k) {
+        if (read) reads.set((addr + k) & 0x0fff);
+        if (write) writes.set((addr + k) & 0x0fff);
+    }
+    update();
+}
+
+void debugger_t::clear(uint16_t addr) {
+    addr &= 0x0fff;
+    breakpoints.reset(addr);
+    conditional.reset(addr);
+    reads.reset(addr);
+    writes.reset(addr);
+    for (auto c = conditions.begin(); c != conditions.end(); )
+        c = c->first == addr ? conditions.erase(c) : c + 1;
+    update();
+}
+
+bool debugger_t::test(const condition_t & cond, uint8_t value) const {
+    switch (cond.cmp) {
+    case cmp_t::eq: return value == cond.value;
+    case cmp_t::ne: return value != cond.value;
+    case cmp_t::lt: return value < cond.value;
+    case cmp_t::gt: return value > cond.value;
+    }
+    return false;
+}
+
+bool debugger_t::watched(const bitset<4096> & bits,
+                         uint16_t addr, uint16_t length) const {
+    for (uint16_t k = 0; k < length; ++k)
+        if (bits[(addr + k) & 0x0fff]) return true;
+    return false;
+}
+
+uint16_t debugger_t::number(const string & s, unsigned max,
+                            const char * what) {
+    // stoul alone takes "0x2zz" as 2, and "-1" as a huge value
+    size_t end = 0;
+    unsigned long n = 0;
+    try {
+        if (!s.empty() && isdigit((unsigned char) s[0]))
+            n = stoul(s, &end, 0);
+    } catch (const out_of_range &) {
+        n = ULONG_MAX, end = s.size();
+    }
+    if (end == 0 || end != s.size())
+        throw runtime_error(string("bad ") + what + ": " + s);
+    if (n > max)
+        throw runtime_error(string(what) + " out of range: " + s);
+    return n;
+}
+
+uint16_t debugger_t::address(istream & args) {
+    string s;
+    if (!(args >> s)) throw runtime_error("address expected");
+    return number(s, 0x0fff, "address");
+}
+
+bool debugger_t::command(const string & cmd, istream & args, ostream & out) {
+    if (cmd == "c") {
+        over_sp = -1;
+        skip = true;
+        update();
+        return true;
+    } else if (cmd == "s") {
+        over_sp = -1;
+        stepping = true;
+        skip = true;
+        update();
+        return true;
+    } else if (cmd == "b") {
+        uint16_t addr = address(args);
+        string word, reg, op;
+        if (!(args >> word)) {
+            set_breakpoint(addr);
+            return false;
+        }
+        // b <addr> if V<x> <op> <value>
+        args >> reg >> op;
+        // one hex digit: V1 but not V10 or Vg
+        if (word != "if" || reg.size() != 2 || toupper(reg[0]) != 'V'
+                || !isxdigit((unsigned char) reg[1]))
+            throw runtime_error("expected: b <addr> if V<x> <op> <value>");
+        condition_t cond;
+        cond.reg = stoul(reg.substr(1), 0, 16);
+        if      (op == "==") cond.cmp = cmp_t::eq;
+        else if (op == "!=") cond.cmp = cmp_t::ne;
+        else if (op == "<")  cond.cmp = cmp_t::lt;
+        else if (op == ">")  cond.cmp = cmp_t::gt;
+        else throw runtime_error("unknown comparison: " + op);
+        string value;
+        if (!(args >> value)) throw runtime_error("value expected");
+        cond.value = number(value, 0xff, "value");
+        set_breakpoint(addr, cond);
+    } else if (cmd == "w") {
+        // w r|w|rw <addr> [length]
+        string mode;
+        args >> mode;
+        if (mode != "r" && mode != "w" && mode != "rw")
+            throw runtime_error("expected: w r|w|rw <addr> [length]");
+        uint16_t addr = address(args);
+        string n;
+        uint16_t length = (args >> n) ? number(n, 0x1000, "length") : 1;
+        set_watchpoint(addr, length,
+                       mode.find('r') != string::npos,
+                       mode.find('w') != string::npos);
+    } else if (cmd == "d") {
+        clear(address(args));
+    } else if (cmd == "h") {
+        out << "c                         continue\n"
+               "s                         step\n"
+               "n                         step over calls\n"
+               "b <addr> [if V<x> <op> <value>]\n"
+               "                          break at addr, op is == != < >\n"
+               "w r|w|rw <addr> [length]  watch memory\n"
+               "d <addr>                  delete break and watch points\n"
+               "r                         show registers\n"
+               "x [addr] [count]          dump memory\n"
+               "l [addr] [count]          list instructions\n"
+               "q                         quit" << endl;
+    } else {
+        out << "unknown command: " << cmd << ", h for help" << endl;
+    }
+    return false;
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include "chip8.h"
+#include <bitset>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+    Breakpoints, watchpoints and stepping. Breakpoints and watchpoints are
+    bitmaps over the address space, so checking an instruction costs a few
+    bit tests. The interpreter only calls check() from the debug
+    instantiation of its step(), which it switches to while armed() is true;
+    with nothing armed the debugger costs nothing.
+
+    The machine is duck-typed: it has to provide pc, sp, i, v, delay(),
+    sound(), read_byte() and read_word().
+*/
+class debugger_t {
+public:
+
+    enum class cmp_t { eq, ne, lt, gt };
+
+    struct condition_t {
+        uint8_t reg;
+        cmp_t cmp;
+        uint8_t value;
+    };
+
+    debugger_t();
+
+    bool armed() const { return active; }
+
+    // Stops before the next instruction.
+    void pause() { stepping = true; update(); }
+
+    void set_breakpoint(uint16_t addr);
+    void set_breakpoint(uint16_t addr, const condition_t & cond);
+    void set_watchpoint(uint16_t addr, uint16_t length, bool read, bool write);
+    void clear(uint16_t addr);
+
+    // Returns true if execution has to stop before instruction in at m.pc.
+    template <typename machine_t>
+    bool check(const machine_t & m, uint16_t in);
+
+    // Reads commands until one of them resumes execution. Returns false if
+    // the user asked to quit.
+    template <typename machine_t>
+    bool prompt(const machine_t & m, std::istream & in, std::ostream & out);
+
+private:
+
+    std::bitset<4096> breakpoints;
+    std::bitset<4096> conditional;
+    std::bitset<4096> reads;
+    std::bitset<4096> writes;
+    std::vector<std::pair<uint16_t, condition_t>> conditions;
+    bool stepping;
+    bool skip;
+    int over_sp;
+    uint16_t over_pc;
+    bool active;
+    std::string reason;
+
+    void update();
+    bool test(const condition_t & cond, uint8_t value) const;
+    bool watched(const std::bitset<4096> & bits,
+                 uint16_t addr, uint16_t length) const;
+    bool command(const std::string & cmd, std::istream & args,
+                 std::ostream & out);
+    // The whole of s as a number in C notation, at most max; throws
+    // std::runtime_error naming what otherwise.
+    static uint16_t number(const std::string & s, unsigned max,
+                           const char * what);
+    static uint16_t address(std::istream & args);
+
+    template <typename machine_t>
+    static void registers(const machine_t & m, std::ostream & out);
+};
+
+template <typename machine_t>
+bool debugger_t::check(const machine_t & m, uint16_t in) {
+    if (skip) {
+        skip = false;
+        update();
+        return false;
+    }
+    uint16_t pc = m.pc & 0x0fff;
+    if (stepping) {
+        stepping = false;
+        reason = "step";
+        return true;
+    }
+    if (over_sp >= 0 && pc == over_pc && m.sp == over_sp) {
+        over_sp = -1;
+        reason = "step";
+        return true;
+    }
+    if (breakpoints[pc]) {
+        reason = "breakpoint";
+        return true;
+    }
+    if (conditional[pc])
+        for (auto & c : conditions)
+            if (c.first == pc && test(c.second, m.v[c.second.reg])) {
+                reason = "conditional breakpoint";
+                return true;
+            }
+    // memory the instruction is about to touch
+    uint16_t addr = m.i;
+    uint16_t length = 0;
+    bool write = false;
+    uint8_t x = (in >> 8) & 0x000f;
+    switch (in & 0xf000) {
+    case 0x0000: if (in == 0x00ee) addr = m.sp, length = 2; break;
+    case 0x2000: addr = m.sp + 2, length = 2, write = true; break;
+    case 0xd000: length = in & 0x000f; break;
+    case 0xf000:
+        switch (in & 0x00ff) {
+        case 0x33: length = 3, write = true; break;
+        case 0x55: length = x, write = true; break;
+        case 0x65: length = x; break;
+        } break;
+    }
+    if (length && watched(write ? writes : reads, addr, length)) {
+        reason = write ? "write watchpoint" : "read watchpoint";
+        return true;
+    }
+    return false;
+}
+
+template <typename machine_t>
+void debugger_t::registers(const machine_t & m, std::ostream & out) {
+    std::ostringstream s;
+    s << std::hex;
+    for (int k = 0; k < 16; ++k)
+        s << "V" << k << "=" << (int) m.v[k] << (k % 8 == 7 ? "\n" : " ");
+    s << "I=" << m.i << " PC=" << m.pc << " SP=" << m.sp
+      << " DT=" << (int) m.delay() << " ST=" << (int) m.sound() << "\n";
+    out << s.str();
+}
+
+template <typename machine_t>
+bool debugger_t::prompt(const machine_t & m,
+                        std::istream & in, std::ostream & out) {
+    out << reason << ": ";
+    print_instruction(out, m.pc, m.read_word(m.pc));
+    std::string line;
+    while (out << "(chip8) " << std::flush, std::getline(in, line)) {
+        std::istringstream args(line);
+        std::string cmd;
+        args >> cmd;
+        if (cmd.empty()) continue;
+        try {
+            if (cmd == "q") {
+                return false;
+            } else if (cmd == "n") {
+                // step over calls: stop once the call has returned
+                over_sp = -1;
+                if ((m.read_word(m.pc) & 0xf000) == 0x2000) {
+                    over_pc = (m.pc + 2) & 0x0fff;
+                    over_sp = m.sp;
+                } else {
+                    stepping = true;
+                }
+                skip = true;
+                update();
+                return true;
+            } else if (cmd == "r") {
+                registers(m, out);
+            } else if (cmd == "x" || cmd == "l") {
+                std::string a, n;
+                args >> a >> n;
+                uint16_t addr = a.empty() ? m.pc
+                              : number(a, 0x0fff, "address");
+                uint16_t count = n.empty() ? 8
+                               : number(n, 0x1000, "count");
+                std::ostringstream s;
+                s << std::hex;
+                for (uint16_t k = 0; k < count; ++k) {
+                    uint16_t at = (addr + (cmd == "x" ? k : 2 * k)) & 0x0fff;
+                    if (cmd == "l") {
+                        print_instruction(s, at, m.read_word(at));
+                    } else {
+                        if (k % 16 == 0) s << (k ? "\n" : "") << at << ":";
+                        s << " " << (int) m.read_byte(at);
+                    }
+                }
+                out << s.str() << (cmd == "x" ? "\n" : "");
+            } else if (command(cmd, args, out)) {
+                return true;
+            }
+        } catch (const std::exception & e) {
+            out << "error: " << e.what() << std::endl;
+        }
+    }
+    return false;
+}
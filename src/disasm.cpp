@@ -0,0 +1,148 @@
+#include "chip8.h"
+#include "analysis.h"
+#include "machine.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+
+using namespace std;
+
+template <typename T>
+string hex(T val) {
+    static const char * h = "0123456789abcdef";
+    const auto len = sizeof(T) * 2;
+    string res;
+    res.resize(len);
+    for (int i = 0; i < len; ++i)
+        res[i] = h[(val >> (4 * (len - 1 - i))) & 0xf];
+    return res;
+}
+
+vector<string> show(uint16_t in) {
+    uint16_t nnn = in & 0x0fff;
+    uint8_t n    = in & 0x000f;
+    uint8_t x    = (in >> 8) & 0x000f;
+    uint8_t y    = (in >> 4) & 0x000f;
+    uint8_t kk   = in & 0x00ff;
+    vector<string> res;
+    switch (in & 0xf000) {
+    case 0x0000: 
+        switch (kk) {
+        default: throw unknown_instruction_exception(in);
+        case 0xee: res = { "ret" }; break;
+        case 0xe0: res = { "cls" }; break;
+        } break;
+    case 0x1000: res = { "jp", "0x" + hex(nnn) }; break;
+    case 0x2000: res = { "call", "0x" + hex(nnn) }; break;
+    case 0x3000: res = { "se", "V" + hex(x), "0x" + hex(kk) }; break;
+    case 0x4000: res = { "sne", "V" + hex(x), "0x" + hex(kk) }; break;
+    case 0x5000: res = { "se", "V" + hex(x), "V" + hex(y) }; break;
+    case 0x6000: res = { "ld", "V" + hex(x), "0x" + hex(kk) }; break;
+    case 0x7000: res = { "add", "V" + hex(x), "0x" + hex(kk) }; break;
+    case 0x8000: 
+        switch (n) {
+        default: throw unknown_instruction_exception(in);
+        case 0x0: res = { "ld", "V" + hex(x), "V" + hex(y) }; break;
+        case 0x1: res = { "or", "V" + hex(x), "V" + hex(y) }; break;
+        case 0x2: res = { "and", "V" + hex(x), "V" + hex(y) }; break;
+        case 0x3: res = { "xor", "V" + hex(x), "V" + hex(y) }; break;
+        case 0x4: res = { "add", "V" + hex(x), "V" + hex(y) }; break;
+        case 0x5: res = { "sub", "V" + hex(x), "V" + hex(y) }; break;
+        case 0x6: res = { "shr", "V" + hex(x) }; break;
+        case 0x7: res = { "subn", "V" + hex(x), "V" + hex(y) }; break;
+        case 0xe: res = { "shl", "V" + hex(x) }; break;
+        } break;
+    case 0x9000: res = { "sne", "V" + hex(x), "V" + hex(y) }; break;
+    case 0xa000: res = { "ld", "I", "0x" + hex(nnn) }; break;
+    case 0xb000: res = { "jp", "V0", "0x" + hex(nnn) }; break;
+    case 0xc000: res = { "rnd", "V" + hex(x), "0x" + hex(kk) }; break;
+    case 0xd000: res = { "drw", "V" + hex(x), "V" + hex(y), "0x" + hex(n) }; 
+                 break;
+    case 0xe000: 
+        switch (kk) {
+        default: throw unknown_instruction_exception(in);
+        case 0x9e: res = { "skp", "V" + hex(x) }; break;
+        case 0xa1: res = { "sknp", "V" + hex(x) }; break;
+        } break;
+    case 0xf000: 
+        switch (kk) {
+        default: throw unknown_instruction_exception(in);
+        case 0x07: res = { "ld", "V" + hex(x), "DT" }; break;
+        case 0x0a: res = { "ld", "V" + hex(x), "K" }; break;
+        case 0x15: res = { "ld", "DT", "V" + hex(x) }; break;
+        case 0x18: res = { "ld", "ST", "V" + hex(x) }; break;
+        case 0x1e: res = { "add", "I", "V" + hex(x) }; break;
+        case 0x29: res = { "ld", "F", "V" + hex(x) }; break;
+        case 0x33: res = { "ld", "B", "V" + hex(x) }; break;
+        case 0x55: res = { "ld", "[I]", "V" + hex(x) }; break;
+        case 0x65: res = { "ld", "V" + hex(x), "[I]" }; break;
+        }
+    }
+    return res;
+}
+
+void print_instruction(ostream & out, uint16_t addr, uint16_t in) {
+    out << "0x" << hex(addr) << ":   "
+        << "<" << hex(in) << ">    ";
+    try {
+        auto s = show(in);
+        out << setw(6) << left << s[0] << " ";
+        if (s.size() > 1)
+            out << s[1];
+        for (int i = 2; i < s.size(); ++i)
+            out << ", " << s[i];
+        out << endl;
+    } catch (unknown_instruction_exception e) {
+        out << e.what() << endl;
+    }
+}
+
+// A byte of data, with its pixels in case it is a sprite row.
+static void print_byte(ostream & out, uint16_t addr, uint8_t byte) {
+    string pixels;
+    for (int k = 7; k >= 0; --k)
+        pixels += (byte >> k) & 1 ? '#' : '.';
+    out << "0x" << hex(addr) << ":   "
+        << "<" << hex(byte) << ">      "
+        << setw(6) << left << "db" << " 0x" << hex(byte)
+        << "    ; " << pixels << endl;
+}
+
+void disassemble(istream & source, ostream & out) {
+    string program(istreambuf_iterator<char>(source),
+                   (istreambuf_iterator<char>()));
+    const analysis_t & a = memory_t::analysis(program);
+    const uint16_t start = machine_t::PROGRAM_START_ADDRESS;
+    const uint16_t end = start + min<size_t>(program.size(), 4096 - start);
+    auto byte = [&](uint16_t addr) -> uint8_t {
+        return program[addr - start];
+    };
+    uint16_t addr = start;
+    while (addr < end) {
+        if (a.calls.count(addr))
+            out << endl << "; subroutine 0x" << hex(addr) << endl;
+        bool decoded = a.starts[addr] && addr + 1 < end;
+        // nobody was seen to get here, but a computed jump might have
+        if (!a.computed_jumps.empty()
+                && a.kinds[addr] == analysis_t::unknown && addr + 1 < end
+                && (addr - start) % 2 == 0
+                && a.kinds[addr + 1] == analysis_t::unknown) {
+            uint16_t in = (byte(addr) << 8) | byte(addr + 1);
+            decoded = decode(in) != op_unknown;
+        }
+        if (!decoded) {
+            print_byte(out, addr, byte(addr));
+            ++addr;
+            continue;
+        }
+        if (find(a.computed_jumps.begin(), a.computed_jumps.end(), addr)
+                != a.computed_jumps.end())
+            out << "; computed jump, not followed" << endl;
+        if (find(a.code_writes.begin(), a.code_writes.end(), addr)
+                != a.code_writes.end())
+            out << "; stores over code" << endl;
+        print_instruction(out, addr, (byte(addr) << 8) | byte(addr + 1));
+        addr += 2;
+    }
+}
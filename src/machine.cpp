@@ -0,0 +1,486 @@
+#include "machine.h"
+#include "analysis.h"
+#include "debugger.h"
+#include "trace.h"
+#include <iterator>
+#include <istream>
+#include <limits>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+static string hex4(uint16_t val) {
+    static const char * h = "0123456789abcdef";
+    string res(4, '0');
+    for (int i = 0; i < 4; ++i)
+        res[i] = h[(val >> (4 * (3 - i))) & 0xf];
+    return res;
+}
+
+unknown_instruction_exception::unknown_instruction_exception(uint16_t in)
+        : runtime_error("unknown instruction: " + hex4(in)) { }
+
+namespace {
+
+struct fusion_t {
+    array<op_t, 3> ops;
+    int length;
+    int (machine_t::*run)(const uint8_t * code);
+};
+
+// The superinstructions, generated at build time from profiles of the ROMs
+// in games/, see tools/fusegen.cpp. The first one that matches wins.
+#define FUSE(a, b, c) { { { op_##a, op_##b, op_##c } }, \
+                        op_##c == op_none ? 2 : 3, \
+                        &machine_t::fused<op_##a, op_##b, op_##c> },
+const fusion_t FUSIONS[] = {
+#ifndef NO_FUSION
+#include "fusion.inc"
+#endif
+    { { { op_none, op_none, op_none } }, 0, nullptr }
+};
+#undef FUSE
+
+const int FUSION_COUNT = sizeof(FUSIONS) / sizeof(FUSIONS[0]) - 1;
+
+// Marks where each superinstruction starts in p. Sequences have to fit in
+// the page, so that a private copy of any page they touch drops them.
+void fuse(memory_t::page_t & p) {
+    const int size = memory_t::PAGE_SIZE;
+    for (int offset = 0; offset + 4 <= size; ++offset) {
+        for (int k = 0; k < FUSION_COUNT; ++k) {
+            const fusion_t & f = FUSIONS[k];
+            if (offset + 2 * f.length > size) continue;
+            bool match = true;
+            for (int l = 0; l < f.length && match; ++l) {
+                uint16_t in = (p.data[offset + 2 * l] << 8)
+                            | p.data[offset + 2 * l + 1];
+                match = decode(in) == f.ops[l]
+                     && fusible(f.ops[l], l + 1 == f.length);
+            }
+            if (!match) continue;
+            if (!p.fused) {
+                p.fused.reset(new uint8_t[size]);
+                fill_n(p.fused.get(), size, 0);
+            }
+            p.fused[offset] = k + 1;
+            break;
+        }
+    }
+}
+
+// Machine cycles the VIP interpreter takes for in, after the 40 all
+// instructions spend being fetched and decoded. Measured on the original
+// interpreter; where the time depends on data, the typical case.
+int vip_cycles(uint16_t in) {
+    const int FETCH = 40;
+    uint8_t x = (in >> 8) & 0x000f;
+    uint8_t n = in & 0x000f;
+    switch (decode(in)) {
+    case op_cls:      return FETCH + 24;
+    case op_ret:      return FETCH + 10;
+    case op_jp:       return FETCH + 12;
+    case op_call:     return FETCH + 26;
+    case op_se_byte: case op_sne_byte:
+                      return FETCH + 10;
+    case op_se_reg: case op_sne_reg:
+                      return FETCH + 14;
+    case op_ld_byte:  return FETCH + 6;
+    case op_add_byte: return FETCH + 10;
+    // the arithmetic goes through a subroutine the interpreter builds in RAM
+    case op_ld_reg: case op_or_reg: case op_and_reg: case op_xor_reg:
+    case op_add_reg: case op_sub_reg: case op_shr: case op_subn: case op_shl:
+                      return FETCH + 44;
+    case op_ld_i:     return FETCH + 12;
+    case op_jp_v0:    return FETCH + 22;
+    case op_rnd:      return FETCH + 36;
+    // rows are shifted into place one bit at a time, about 4 per row
+    case op_drw:      return FETCH + 26 + 64 * n;
+    case op_skp: case op_sknp:
+                      return FETCH + 14;
+    case op_ld_vx_dt: case op_ld_dt_vx: case op_ld_st_vx:
+                      return FETCH + 10;
+    case op_ld_vx_k:  return FETCH + 16;
+    case op_add_i:    return FETCH + 16;
+    case op_ld_f:     return FETCH + 20;
+    case op_ld_b:     return FETCH + 160;
+    // 14 a byte, for the x registers this interpreter copies; the VIP's
+    // own copies V0..Vx, but timing follows what actually runs
+    case op_ld_mem_vx: case op_ld_vx_mem:
+                      return FETCH + 14 + 14 * x;
+    default:          return FETCH;
+    }
+}
+
+const uint8_t FONT[] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // "0"
+    0x20, 0x60, 0x20, 0x20, 0x70, // "1"
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // "2"
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // "3"
+    0x90, 0x90, 0xF0, 0x10, 0x10, // "4"
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // "5"
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // "6"
+    0xF0, 0x10, 0x20, 0x40, 0x40, // "7"
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // "8"
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // "9"
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // "A"
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // "B"
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // "C"
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // "D"
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // "E"
+    0xF0, 0x80, 0xF0, 0x80, 0x80, // "F"
+};
+
+// One image per distinct program, kept for the life of the process. The
+// registry holds a reference to every page so they never drop back to
+// private; identical pages within an image are stored once. The analysis
+// of the program is made the first time it is asked for.
+struct image_t {
+    memory_t::pages_t pages;
+    unique_ptr<analysis_t> analysis;
+};
+
+mutex images_mutex;
+map<string, image_t> images;
+
+// Call with images_mutex held.
+image_t & image_locked(const string & program) {
+    auto found = images.find(program);
+    if (found != images.end()) return found->second;
+    array<uint8_t, 4096> bytes;
+    bytes.fill(0);
+    copy(begin(FONT), end(FONT), bytes.begin());
+    copy_n(program.begin(),
+           min<size_t>(program.size(), 4096 - machine_t::PROGRAM_START_ADDRESS),
+           bytes.begin() + machine_t::PROGRAM_START_ADDRESS);
+    memory_t::pages_t pages;
+    for (int k = 0; k < memory_t::PAGES; ++k) {
+        auto from = bytes.begin() + k * memory_t::PAGE_SIZE;
+        memory_t::page_t * p = nullptr;
+        for (int l = 0; l < k && !p; ++l)
+            if (equal(from, from + memory_t::PAGE_SIZE, pages[l]->data.begin()))
+                p = pages[l];
+        if (p) {
+            ++p->refs;
+        } else {
+            p = new memory_t::page_t;
+            p->refs = 1;
+            copy_n(from, memory_t::PAGE_SIZE, p->data.begin());
+            fuse(*p);
+        }
+        pages[k] = p;
+    }
+    return images.emplace(program, image_t{ pages, nullptr }).first->second;
+}
+
+memory_t::pages_t image(const string & program) {
+    lock_guard<mutex> lock(images_mutex);
+    return image_locked(program).pages;
+}
+
+} // namespace
+
+memory_t::memory_t() : pages(image("")) {
+    for (auto p : pages) acquire(p);
+}
+
+memory_t::memory_t(const memory_t & m) : pages(m.pages) {
+    for (auto p : pages) acquire(p);
+}
+
+memory_t & memory_t::operator=(const memory_t & m) {
+    for (auto p : m.pages) acquire(p);
+    for (auto p : pages) release(p);
+    pages = m.pages;
+    return *this;
+}
+
+memory_t::~memory_t() {
+    for (auto p : pages) release(p);
+}
+
+void memory_t::load(const string & program) {
+    auto loaded = image(program);
+    for (auto p : loaded) acquire(p);
+    for (auto p : pages) release(p);
+    pages = loaded;
+}
+
+memory_t::page_t * memory_t::own(page_t * p) {
+    page_t * copy = new page_t;
+    copy->refs = 1;
+    copy->data = p->data;
+    release(p);
+    return copy;
+}
+
+const analysis_t & memory_t::analysis(const string & program) {
+    lock_guard<mutex> lock(images_mutex);
+    image_t & image = image_locked(program);
+    if (!image.analysis) image.analysis.reset(new analysis_t(program));
+    return *image.analysis;
+}
+
+int memory_t::private_pages() const {
+    return count_if(pages.begin(), pages.end(),
+                    [](const page_t * p) { return p->refs == 1; });
+}
+
+bool machine_t::display_t::draw(int i, int j, const uint8_t * sprite,
+                                int length) {
+    bool erased = false;
+    for (int k = 0; k < length; ++k) {
+        // leftmost pixel in the top bit, rotated so it wraps around
+        uint64_t bits = uint64_t(sprite[k]) << 56;
+        int shift = i & 63;
+        if (shift) bits = (bits >> shift) | (bits << (64 - shift));
+        uint64_t & row = rows[(j + k) & 31];
+        erased |= (row & bits) != 0;
+        row ^= bits;
+    }
+    return erased;
+}
+
+machine_t::machine_t()
+        : i(0), pc(PROGRAM_START_ADDRESS), sp(STACK_ADDRESS - 1)
+        , dt{ 0, 0 }, st{ 0, 0 }, keys(0), wait_for_key(false)
+        , put_key_in(0), seed(2463534242), cycle(0), vip(false)
+        , vblank(true) {
+    display.clear();
+    v.fill(0);
+}
+
+void machine_t::load(istream & source) {
+    memory.load(string(istreambuf_iterator<char>(source),
+                       istreambuf_iterator<char>()));
+}
+
+template <op_t K>
+void machine_t::exec(uint16_t in) {
+    uint16_t nnn = in & 0x0fff;
+    uint8_t n    = in & 0x000f;
+    uint8_t x    = (in >> 8) & 0x000f;
+    uint8_t y    = (in >> 4) & 0x000f;
+    uint8_t kk   = in & 0x00ff;
+    switch (K) {
+    case op_cls: display.clear(); break;
+    case op_ret: pc = read_word(sp); sp -= 2; break;
+    case op_jp: pc = nnn - 2; break;
+    case op_call: sp += 2; write_word(sp, pc); pc = nnn - 2; break;
+    case op_se_byte: pc += (v[x] == kk) ? 2 : 0; break;
+    case op_sne_byte: pc += (v[x] != kk) ? 2 : 0; break;
+    case op_se_reg: pc += (v[x] == v[y]) ? 2 : 0; break;
+    case op_ld_byte: v[x] = kk; break;
+    case op_add_byte: v[x] += kk; break;
+    case op_ld_reg: v[x] = v[y]; break;
+    case op_or_reg: v[x] |= v[y]; break;
+    case op_and_reg: v[x] &= v[y]; break;
+    case op_xor_reg: v[x] ^= v[y]; break;
+    case op_add_reg: v[x] += v[y]; v[0xf] = v[x] < v[y]; break;
+    case op_sub_reg: v[0xf] = v[x] > v[y]; v[x] -= v[y]; break;
+    case op_shr: v[0xf] = v[x] & 1; v[x] >>= 1; break;
+    case op_subn: v[0xf] = v[y] > v[x]; v[y] -= v[x]; break;
+    case op_shl: v[0xf] = v[x] & (1 << 7); v[x] <<= 1; break;
+    case op_sne_reg: pc += (v[x] != v[y]) ? 2 : 0; break;
+    case op_ld_i: i = nnn; break;
+    case op_jp_v0: pc = nnn + v[0] - 2; break;
+    case op_rnd: v[x] = random() & kk; break;
+    case op_drw: v[0xf] = draw(x, y, n); break;
+    case op_skp: pc += key_down(v[x]) ? 2 : 0; break;
+    case op_sknp: pc += key_down(v[x]) ? 0 : 2; break;
+    case op_ld_vx_dt: v[x] = delay(); break;
+    case op_ld_vx_k: wait_for_key = true; put_key_in = x; break;
+    case op_ld_dt_vx: dt.set(v[x], ticks()); break;
+    case op_ld_st_vx: st.set(v[x], ticks()); break;
+    case op_add_i: i += v[x]; break;
+    case op_ld_f: i = v[x] * 5; break;
+    case op_ld_b: write_bcd(x); break;
+    case op_ld_mem_vx: for (int k = 0; k < x; ++k) memory.write(i + k, v[k]);
+                       break;
+    case op_ld_vx_mem: for (int k = 0; k < x; ++k) v[k] = memory.read(i + k);
+                       break;
+    case op_unknown: case op_none: throw unknown_instruction_exception(in);
+    }
+}
+
+// The same tree as decode(), going straight to the handlers. Inlined into
+// every loop, a call per instruction costs as much as the dispatch itself.
+#ifdef __GNUC__
+__attribute__((always_inline))
+#endif
+inline void machine_t::execute(uint16_t in) {
+    switch (in & 0xf000) {
+    case 0x0000:
+        switch (in & 0x00ff) {
+        case 0xe0: return exec<op_cls>(in);
+        case 0xee: return exec<op_ret>(in);
+        } break;
+    case 0x1000: return exec<op_jp>(in);
+    case 0x2000: return exec<op_call>(in);
+    case 0x3000: return exec<op_se_byte>(in);
+    case 0x4000: return exec<op_sne_byte>(in);
+    case 0x5000: return exec<op_se_reg>(in);
+    case 0x6000: return exec<op_ld_byte>(in);
+    case 0x7000: return exec<op_add_byte>(in);
+    case 0x8000:
+        switch (in & 0x000f) {
+        case 0x0: return exec<op_ld_reg>(in);
+        case 0x1: return exec<op_or_reg>(in);
+        case 0x2: return exec<op_and_reg>(in);
+        case 0x3: return exec<op_xor_reg>(in);
+        case 0x4: return exec<op_add_reg>(in);
+        case 0x5: return exec<op_sub_reg>(in);
+        case 0x6: return exec<op_shr>(in);
+        case 0x7: return exec<op_subn>(in);
+        case 0xe: return exec<op_shl>(in);
+        } break;
+    case 0x9000: return exec<op_sne_reg>(in);
+    case 0xa000: return exec<op_ld_i>(in);
+    case 0xb000: return exec<op_jp_v0>(in);
+    case 0xc000: return exec<op_rnd>(in);
+    case 0xd000: return exec<op_drw>(in);
+    case 0xe000:
+        switch (in & 0x00ff) {
+        case 0x9e: return exec<op_skp>(in);
+        case 0xa1: return exec<op_sknp>(in);
+        } break;
+    case 0xf000:
+        switch (in & 0x00ff) {
+        case 0x07: return exec<op_ld_vx_dt>(in);
+        case 0x0a: return exec<op_ld_vx_k>(in);
+        case 0x15: return exec<op_ld_dt_vx>(in);
+        case 0x18: return exec<op_ld_st_vx>(in);
+        case 0x1e: return exec<op_add_i>(in);
+        case 0x29: return exec<op_ld_f>(in);
+        case 0x33: return exec<op_ld_b>(in);
+        case 0x55: return exec<op_ld_mem_vx>(in);
+        case 0x65: return exec<op_ld_vx_mem>(in);
+        } break;
+    }
+    exec<op_unknown>(in);
+}
+
+template <bool debug, bool trace>
+bool machine_t::step(debugger_t * debugger, trace_t * tracer) {
+    uint16_t in  = read_word(pc);
+    if (debug && debugger->check(*this, in)) return false;
+    if (trace) tracer->begin(pc, in);
+    execute(in);
+    if (trace) {
+        // 8xy7 leaves its result in Vy
+        int r = (in & 0xf00f) == 0x8007 ? (in >> 4) & 0x000f
+                                        : (in >> 8) & 0x000f;
+        tracer->end(i, v[r], v[0xf]);
+    }
+    pc += 2;
+    return true;
+}
+
+template <op_t a, op_t b, op_t c>
+int machine_t::fused(const uint8_t * code) {
+    uint16_t start = pc;
+    exec<a>((code[0] << 8) | code[1]);
+    pc += 2;
+    if (pc != uint16_t(start + 2)) return 1;
+    exec<b>((code[2] << 8) | code[3]);
+    pc += 2;
+    if (c == op_none) return 2;
+    if (pc != uint16_t(start + 4)) return 2;
+    exec<c>((code[4] << 8) | code[5]);
+    pc += 2;
+    return 3;
+}
+
+int machine_t::run_plain(int n) {
+    int k = 0;
+    while (k < n && !wait_for_key) {
+        const memory_t::page_t * p = memory.page(pc);
+        uint16_t offset = pc & (memory_t::PAGE_SIZE - 1);
+        // only shared pages have superinstructions, and their code can't
+        // change: writing to one gives the writer a private copy
+        if (p->fused && p->fused[offset]) {
+            const fusion_t & f = FUSIONS[p->fused[offset] - 1];
+            if (k + f.length <= n) {
+                k += (this->*f.run)(&p->data[offset]);
+                continue;
+            }
+        }
+        uint16_t in = offset + 1 < memory_t::PAGE_SIZE
+                    ? (p->data[offset] << 8) | p->data[offset + 1]
+                    : read_word(pc);
+        execute(in);
+        pc += 2;
+        ++k;
+    }
+    return k;
+}
+
+bool machine_t::step_with(debugger_t * debugger, trace_t * tracer) {
+    bool debug = debugger && debugger->armed();
+    return tracer ? debug ? step<true, true>(debugger, tracer)
+                          : step<false, true>(debugger, tracer)
+                  : debug ? step<true, false>(debugger, tracer)
+                          : step<false, false>(debugger, tracer);
+}
+
+bool machine_t::run_until(uint64_t end, int n, debugger_t * debugger,
+                          trace_t * tracer) {
+    int k = 0;
+    while (k < n && cycle < end && !wait_for_key) {
+        if (vip) {
+            uint16_t in = read_word(pc);
+            uint64_t next = frame_end();
+            // Dxyn waits for the interrupt, the rest of the frame is lost
+            if ((in & 0xf000) == 0xd000 && !vblank) {
+                if (next >= end) break;
+                cycle = next;
+                vblank = true;
+                continue;
+            }
+            if (!step_with(debugger, tracer)) return false;
+            cycle += vip_cycles(in);
+            vblank = cycle >= next;
+            ++k;
+            continue;
+        }
+        // nothing arms the debugger while the program runs
+        if (!tracer && !(debugger && debugger->armed())) {
+            // no further than the end of the frame, so that the timers
+            // tick in between
+            uint64_t stop = min(end, frame_end());
+            int done = run_plain(min<uint64_t>(n - k, stop - cycle));
+            k += done;
+            cycle += done;
+            continue;
+        }
+        if (!step_with(debugger, tracer)) return false;
+        ++k;
+        ++cycle;
+    }
+    return true;
+}
+
+bool machine_t::run(int n, debugger_t * debugger, trace_t * tracer) {
+    return run_until(numeric_limits<uint64_t>::max(), n, debugger, tracer);
+}
+
+bool machine_t::run_to_vblank(debugger_t * debugger, trace_t * tracer) {
+    const uint64_t end = frame_end();
+    if (!run_until(end, numeric_limits<int>::max(), debugger, tracer))
+        return false;
+    // an instruction running over takes from the next frame
+    cycle = max(cycle, end);
+    vblank = true;
+    return true;
+}
+
+bool machine_t::step_frame(uint64_t end) {
+    // every instruction takes time, waiting for something doesn't
+    uint64_t before = cycle;
+    run_until(end, 1, nullptr, nullptr);
+    if (cycle != before) return true;
+    cycle = max(cycle, end);
+    vblank = true;
+    return false;
+}
@@ -0,0 +1,369 @@
+#pragma once
+
+#include "chip8.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+class analysis_t;
+class debugger_t;
+class trace_t;
+
+// Instruction kinds: what the interpreter dispatches on and what
+// superinstructions are made of.
+#define CHIP8_OPS(OP) \
+    OP(cls) OP(ret) OP(jp) OP(call) OP(se_byte) OP(sne_byte) OP(se_reg) \
+    OP(ld_byte) OP(add_byte) OP(ld_reg) OP(or_reg) OP(and_reg) \
+    OP(xor_reg) OP(add_reg) OP(sub_reg) OP(shr) OP(subn) OP(shl) \
+    OP(sne_reg) OP(ld_i) OP(jp_v0) OP(rnd) OP(drw) OP(skp) OP(sknp) \
+    OP(ld_vx_dt) OP(ld_vx_k) OP(ld_dt_vx) OP(ld_st_vx) OP(add_i) \
+    OP(ld_f) OP(ld_b) OP(ld_mem_vx) OP(ld_vx_mem) OP(unknown)
+
+enum op_t {
+#define CHIP8_OP_ENUM(name) op_##name,
+    CHIP8_OPS(CHIP8_OP_ENUM)
+#undef CHIP8_OP_ENUM
+    op_none
+};
+
+inline op_t decode(uint16_t in) {
+    switch (in & 0xf000) {
+    case 0x0000:
+        switch (in & 0x00ff) {
+        case 0xe0: return op_cls;
+        case 0xee: return op_ret;
+        } break;
+    case 0x1000: return op_jp;
+    case 0x2000: return op_call;
+    case 0x3000: return op_se_byte;
+    case 0x4000: return op_sne_byte;
+    case 0x5000: return op_se_reg;
+    case 0x6000: return op_ld_byte;
+    case 0x7000: return op_add_byte;
+    case 0x8000:
+        switch (in & 0x000f) {
+        case 0x0: return op_ld_reg;
+        case 0x1: return op_or_reg;
+        case 0x2: return op_and_reg;
+        case 0x3: return op_xor_reg;
+        case 0x4: return op_add_reg;
+        case 0x5: return op_sub_reg;
+        case 0x6: return op_shr;
+        case 0x7: return op_subn;
+        case 0xe: return op_shl;
+        } break;
+    case 0x9000: return op_sne_reg;
+    case 0xa000: return op_ld_i;
+    case 0xb000: return op_jp_v0;
+    case 0xc000: return op_rnd;
+    case 0xd000: return op_drw;
+    case 0xe000:
+        switch (in & 0x00ff) {
+        case 0x9e: return op_skp;
+        case 0xa1: return op_sknp;
+        } break;
+    case 0xf000:
+        switch (in & 0x00ff) {
+        case 0x07: return op_ld_vx_dt;
+        case 0x0a: return op_ld_vx_k;
+        case 0x15: return op_ld_dt_vx;
+        case 0x18: return op_ld_st_vx;
+        case 0x1e: return op_add_i;
+        case 0x29: return op_ld_f;
+        case 0x33: return op_ld_b;
+        case 0x55: return op_ld_mem_vx;
+        case 0x65: return op_ld_vx_mem;
+        } break;
+    }
+    return op_unknown;
+}
+
+// Whether op can be part of a superinstruction, last or not. Anything but
+// the last has to be able to fall through and must not write memory, which
+// could be the code that follows it.
+inline bool fusible(op_t op, bool last) {
+    switch (op) {
+    case op_ld_vx_k: case op_unknown: case op_none:
+        return false;
+    case op_jp: case op_call: case op_ret: case op_jp_v0:
+    case op_ld_b: case op_ld_mem_vx:
+        return last;
+    default:
+        return true;
+    }
+}
+
+struct unknown_instruction_exception : std::runtime_error {
+    unknown_instruction_exception(uint16_t in);
+};
+
+/*
+    Guest memory split into pages. Every machine that loaded the same
+    program starts out sharing the pages of one image, font included, and
+    gets a private copy of a page the first time it writes to it. Copying
+    memory_t copies the page table only, so snapshots are cheap too.
+*/
+class memory_t {
+public:
+
+    static const int PAGE_BITS = 7;
+    static const uint16_t PAGE_SIZE = 1 << PAGE_BITS;
+    static const int PAGES = 4096 / PAGE_SIZE;
+
+    struct page_t {
+        std::atomic<unsigned> refs;
+        std::array<uint8_t, PAGE_SIZE> data;
+        // superinstruction starting at each offset, shared pages only
+        std::unique_ptr<uint8_t[]> fused;
+    };
+
+    using pages_t = std::array<page_t *, PAGES>;
+
+    // Font only, as if an empty program was loaded.
+    memory_t();
+    memory_t(const memory_t & m);
+    memory_t & operator=(const memory_t & m);
+    ~memory_t();
+
+    // Font at 0, program at 0x200, the rest zero.
+    void load(const std::string & program);
+
+    uint8_t read(uint16_t addr) const {
+        return page(addr)->data[addr & (PAGE_SIZE - 1)];
+    }
+
+    void write(uint16_t addr, uint8_t byte) {
+        page_t *& p = pages[(addr >> PAGE_BITS) & (PAGES - 1)];
+        if (p->refs.load(std::memory_order_acquire) != 1) p = own(p);
+        p->data[addr & (PAGE_SIZE - 1)] = byte;
+    }
+
+    const page_t * page(uint16_t addr) const {
+        return pages[(addr >> PAGE_BITS) & (PAGES - 1)];
+    }
+
+    // Pages nobody else references.
+    int private_pages() const;
+
+    // The analysis of program, made once and kept with its image.
+    static const analysis_t & analysis(const std::string & program);
+
+private:
+
+    pages_t pages;
+
+    static page_t * own(page_t * p);
+    static void acquire(page_t * p) {
+        p->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    static void release(page_t * p) {
+        if (p->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete p;
+    }
+
+};
+
+// A 60 Hz timer kept as the value it was set to and the tick it was set at,
+// so nothing has to run while it counts down.
+struct countdown_t {
+    uint8_t value;
+    uint64_t since;
+
+    uint8_t at(uint64_t tick) const {
+        uint64_t gone = tick - since;
+        return gone < value ? value - gone : 0;
+    }
+
+    void set(uint8_t val, uint64_t tick) {
+        value = val;
+        since = tick;
+    }
+};
+
+// Marsaglia's xorshift32, seed must not be 0.
+inline uint32_t xorshift(uint32_t & seed) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+/*
+    The interpreter state and nothing else. It is a plain value: copying it
+    takes a snapshot and assigning the copy back restores it. The window,
+    capture, debugger and trace belong to the frontend and are passed in
+    where they are needed.
+*/
+struct machine_t {
+
+    struct display_t {
+        chip8::frame_t rows;
+
+        bool draw(int i, int j, const uint8_t * sprite, int length);
+        void clear() { rows.fill(0); }
+        const chip8::frame_t & frame() const { return rows; }
+    };
+
+    /*
+        Memory layout:
+        0x0000-0x0050 sprites
+        0x0200-0x0fdf program
+        0x0fe0-0x3fff stack
+    */
+
+    static const uint16_t PROGRAM_START_ADDRESS = 0x0200;
+    static const uint16_t STACK_ADDRESS = 0x0fe0;
+
+    // One instruction per millisecond and a timer tick every 15ms.
+    static const int STEPS_PER_FRAME = 15;
+
+    // COSMAC VIP timing counts machine cycles, 8 clocks of the 1.76 MHz
+    // CPU. Of the 3668 in a 60 Hz frame the display interrupt and its DMA
+    // take 1070, the interpreter gets the rest, which is all the clock
+    // counts.
+    static const int VIP_CYCLES_PER_FRAME = 3668 - 1070;
+
+    memory_t memory;
+    display_t display;
+    std::array<uint8_t, 16> v;
+    uint16_t i;
+    uint16_t pc;
+    uint16_t sp;
+    countdown_t dt;
+    countdown_t st;
+    // bit k set while key k is held down
+    uint16_t keys;
+    bool wait_for_key;
+    uint8_t put_key_in;
+    // Cxkk draws from here rather than rand() so snapshots replay exactly
+    uint32_t seed;
+    // Cycles run so far: an instruction each, or the VIP's machine cycles.
+    // Frames, and timer ticks, are every frame_cycles() of them.
+    uint64_t cycle;
+    bool vip;
+    // VIP timing: nothing ran since the display interrupt, which Dxyn waits
+    // for
+    bool vblank;
+
+    machine_t();
+
+    void load(std::istream & source);
+
+    uint8_t read_byte(uint16_t addr) const { return memory.read(addr); }
+
+    uint16_t read_word(uint16_t addr) const {
+        return (memory.read(addr) << 8) | memory.read(addr + 1);
+    }
+
+    void write_word(uint16_t addr, uint16_t word) {
+        memory.write(addr + 1, word);
+        memory.write(addr, word >> 8);
+    }
+
+    void write_bcd(uint8_t x) {
+        uint8_t val = v[x];
+        memory.write(i    , val % 10);
+        val /= 10;
+        memory.write(i + 1, val % 10);
+        val /= 10;
+        memory.write(i + 2, val % 10);
+    }
+
+    bool draw(uint8_t x, uint8_t y, uint8_t n) {
+        uint8_t sprite[16];
+        for (int k = 0; k < n; ++k)
+            sprite[k] = memory.read(i + k);
+        return display.draw(v[x], v[y], sprite, n);
+    }
+
+    // Sets the keys held down. A key going down ends the wait of Fx0A, the
+    // lowest one if several do.
+    void set_keys(uint16_t down) {
+        uint16_t pressed = down & ~keys;
+        keys = down;
+        if (!wait_for_key || !pressed) return;
+        uint8_t k = 0;
+        while (!((pressed >> k) & 1)) ++k;
+        v[put_key_in] = k;
+        wait_for_key = false;
+    }
+
+    bool key_down(uint8_t k) const { return k < 16 && ((keys >> k) & 1); }
+
+    uint8_t random() { return xorshift(seed); }
+
+    uint64_t frame_cycles() const {
+        return vip ? VIP_CYCLES_PER_FRAME : STEPS_PER_FRAME;
+    }
+
+    // Timer ticks so far.
+    uint64_t ticks() const { return cycle / frame_cycles(); }
+
+    // The cycle the current frame ends at.
+    uint64_t frame_end() const { return (ticks() + 1) * frame_cycles(); }
+
+    uint8_t delay() const { return dt.at(ticks()); }
+    uint8_t sound() const { return st.at(ticks()); }
+
+    // Runs up to n instructions, fewer if the program waits for a key. The
+    // clock goes as in run_to_vblank(), across frame ends: under VIP timing
+    // by the cost of each instruction, with Dxyn first waiting for the
+    // interrupt. Returns false if the debugger stopped execution.
+    bool run(int n, debugger_t * debugger = nullptr,
+             trace_t * tracer = nullptr);
+
+    // Runs to the end of the frame, the clock standing at frame_end() of
+    // when it started. Time spent waiting for a key or, under VIP timing,
+    // for Dxyn's interrupt passes too. Returns false if the debugger stopped
+    // execution, the next call then goes on with the rest of the frame.
+    bool run_to_vblank(debugger_t * debugger = nullptr,
+                       trace_t * tracer = nullptr);
+
+    // run_to_vblank() an instruction at a time, for harnesses that look at
+    // every one: runs the next instruction of the frame ending at end and
+    // returns true, or returns false once the frame is over, the clock then
+    // standing at end as run_to_vblank() leaves it.
+    bool step_frame(uint64_t end);
+
+    // A frame as the host sees it, without debugger and trace. Returns true
+    // while the buzzer sounds.
+    bool run_frame() {
+        run_to_vblank();
+        return sound() != 0;
+    }
+
+    // The debug instantiation asks the debugger before every instruction and
+    // leaves pc untouched, returning false, if it has to stop. The trace
+    // instantiation records every executed instruction.
+    template <bool debug, bool trace>
+    bool step(debugger_t * debugger, trace_t * tracer);
+
+    // Executes in as an instruction of kind K, except for moving on to the
+    // next instruction.
+    template <op_t K>
+    void exec(uint16_t in);
+
+    void execute(uint16_t in);
+
+    // step() for what is attached.
+    bool step_with(debugger_t * debugger, trace_t * tracer);
+
+    // Runs up to n instructions, stopping early when the clock reaches end.
+    bool run_until(uint64_t end, int n, debugger_t * debugger,
+                   trace_t * tracer);
+
+    // Legacy timing without debugger and trace, the only loop using
+    // superinstructions. Returns the number of instructions executed.
+    int run_plain(int n);
+
+    // Runs the superinstruction a, b, c (c may be op_none) from code, which
+    // is where pc points to. Stops early when an instruction doesn't fall
+    // through. Returns the number of instructions executed.
+    template <op_t a, op_t b, op_t c>
+    int fused(const uint8_t * code);
+
+};
@@ -1,31 +1,78 @@
 #include "chip8.h"
+#include "trace.h"
 #include <iostream>
 #include <cstring>
 #include <fstream>
+#include <stdexcept>
 
 using namespace std;
 
 int main(int argc, char ** argv) {
     if (argc < 3) {
-        cout << argv[0] << " -r <program file> ; to run program" << endl;
+        cout << argv[0] << " -r <program file> [-g] [-v] [-x <speed>]"
+                           " [-a <frames>] [-f <filter>]"
+                           " [-c <capture file>] [-t <trace file>]"
+                           " ; to run program" << endl;
         cout << argv[0] << " -d <program file> ; to disassemble program" << endl;
+        cout << argv[0] << " -p <trace file> ; to print trace" << endl;
         return 0;
     }
-    if (strcmp(argv[1], "-r") && strcmp(argv[1], "-d")) {
-        cout << "unknown argument: " << argv[2] << endl;
+    if (strcmp(argv[1], "-r") && strcmp(argv[1], "-d")
+            && strcmp(argv[1], "-p")) {
+        cout << "unknown argument: " << argv[1] << endl;
         return -1;
     }
-    if (argv[1][1] == 'r') {
+    if (argv[1][1] == 'p') {
+        try {
+            trace_t::decode(argv[2], cout);
+        } catch (const runtime_error & e) {
+            cout << "error: " << e.what() << endl;
+            return -1;
+        }
+    } else if (argv[1][1] == 'r') {
         chip8 chip;
-        fstream source(argv[2], ios_base::in | ios_base::binary);   
+        fstream source(argv[2], ios_base::in | ios_base::binary);
         if (!source) {
             cout << "error: can't open file" << endl;
             return -1;
         }
         chip.load(source);
-        chip.start();
+        for (int k = 3; k < argc; ++k) {
+            if (!strcmp(argv[k], "-g")) {
+                chip.debug();
+                continue;
+            }
+            if (!strcmp(argv[k], "-v")) {
+                chip.vip_timing();
+                continue;
+            }
+            if ((strcmp(argv[k], "-c") && strcmp(argv[k], "-t")
+                    && strcmp(argv[k], "-a") && strcmp(argv[k], "-x")
+                    && strcmp(argv[k], "-f"))
+                    || k + 1 == argc) {
+                cout << "unknown argument: " << argv[k] << endl;
+                return -1;
+            }
+            try {
+                if      (argv[k][1] == 'c') chip.capture(argv[k + 1]);
+                else if (argv[k][1] == 't') chip.trace(argv[k + 1]);
+                else if (argv[k][1] == 'x') chip.speed(stod(argv[k + 1]));
+                else if (argv[k][1] == 'f') chip.filter(argv[k + 1]);
+                else    chip.runahead(stoul(argv[k + 1]));
+            } catch (const exception & e) {
+                cout << "error: " << e.what() << endl;
+                return -1;
+            }
+            ++k;
+        }
+        try {
+            chip.start();
+        } catch (const runtime_error & e) {
+            cout << "error: " << e.what() << endl;
+            return -1;
+        }
     } else {
-        fstream source(argv[2], ios_base::in | ios_base::binary);   
+        fstream source(argv[2], ios_base::in | ios_base::binary);
         if (!source) {
             cout << "error: can't open file" << endl;
             return -1;
@@ -0,0 +1,153 @@
+#include "raster.h"
+#include <algorithm>
+#include <stdexcept>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const uint64_t LEFTMOST = uint64_t(1) << 63;
+
+// Each pixel's left and right neighbour, the edges repeating themselves.
+uint64_t left_of(uint64_t row) { return (row >> 1) | (row & LEFTMOST); }
+uint64_t right_of(uint64_t row) { return (row << 1) | (row & 1); }
+
+uint64_t eq(uint64_t a, uint64_t b) { return ~(a ^ b); }
+uint64_t ne(uint64_t a, uint64_t b) { return a ^ b; }
+uint64_t pick(uint64_t c, uint64_t a, uint64_t b) {
+    return (c & a) | (~c & b);
+}
+
+// Bit x of row, leftmost first, to every step-th byte from to.
+void spread(uint64_t row, uint8_t * to, unsigned step) {
+    for (int x = 0; x < 64; ++x, to += step)
+        *to = (row >> (63 - x)) & 1;
+}
+
+uint32_t dim(uint32_t c) { return ((c >> 1) & 0x007f7f7f) | (c & 0xff000000); }
+
+} // namespace
+
+raster_t::filter_t raster_t::parse(const string & name) {
+    if (name == "nearest") return nearest;
+    if (name == "scanline") return scanline;
+    if (name == "scale2x") return scale2x;
+    if (name == "scale3x") return scale3x;
+    throw invalid_argument("unknown filter: " + name);
+}
+
+raster_t::raster_t(filter_t filter, unsigned scale, uint32_t on, uint32_t off)
+        : filter(filter)
+        , factor(filter == scale2x ? 2 : filter == scale3x ? 3 : 1)
+        , repeat(max(1u, scale / factor)), on(on), off(off)
+        , mask(64 * factor * 32 * factor), pixels(width() * height()) { }
+
+// Scale2x and Scale3x as in the reference, with A B C / D E F / G H I the
+// pixel E and its neighbours, for the 64 pixels of a row at once.
+void raster_t::smooth(const chip8::frame_t & frame) {
+    const unsigned w = 64 * factor;
+    for (int y = 0; y < 32; ++y) {
+        uint64_t e = frame[y];
+        uint8_t * row = &mask[y * factor * w];
+        if (factor == 1) {
+            spread(e, row, 1);
+            continue;
+        }
+        uint64_t b = frame[max(y - 1, 0)];
+        uint64_t h = frame[min(y + 1, 31)];
+        uint64_t d = left_of(e), f = right_of(e);
+        uint64_t db = eq(d, b) & ne(b, f) & ne(d, h);
+        uint64_t bf = eq(b, f) & ne(b, d) & ne(f, h);
+        uint64_t dh = eq(d, h) & ne(d, b) & ne(h, f);
+        uint64_t hf = eq(h, f) & ne(d, h) & ne(b, f);
+        if (factor == 2) {
+            spread(pick(db, d, e), row, 2);
+            spread(pick(bf, f, e), row + 1, 2);
+            spread(pick(dh, d, e), row + w, 2);
+            spread(pick(hf, f, e), row + w + 1, 2);
+            continue;
+        }
+        uint64_t a = left_of(b), c = right_of(b);
+        uint64_t g = left_of(h), i = right_of(h);
+        spread(pick(db, d, e), row, 3);
+        spread(pick((db & ne(e, c)) | (bf & ne(e, a)), b, e), row + 1, 3);
+        spread(pick(bf, f, e), row + 2, 3);
+        row += w;
+        spread(pick((db & ne(e, g)) | (dh & ne(e, a)), d, e), row, 3);
+        spread(e, row + 1, 3);
+        spread(pick((bf & ne(e, i)) | (hf & ne(e, c)), f, e), row + 2, 3);
+        row += w;
+        spread(pick(dh, d, e), row, 3);
+        spread(pick((dh & ne(e, i)) | (hf & ne(e, g)), h, e), row + 1, 3);
+        spread(pick(hf, f, e), row + 2, 3);
+    }
+}
+
+// One row of the mask to pixels, each repeated.
+void raster_t::expand(const uint8_t * from, uint32_t * to,
+                      uint32_t lit, uint32_t dark) const {
+    const unsigned n = 64 * factor;
+#ifdef __SSE2__
+    const __m128i vlit = _mm_set1_epi32(lit), vdark = _mm_set1_epi32(dark);
+    if (repeat >= 4) {
+        // a few stores per pixel, the last one overlapping the one before
+        for (unsigned x = 0; x < n; ++x, to += repeat) {
+            __m128i c = from[x] ? vlit : vdark;
+            for (unsigned k = 0; k + 4 < repeat; k += 4)
+                _mm_storeu_si128((__m128i *) (to + k), c);
+            _mm_storeu_si128((__m128i *) (to + repeat - 4), c);
+        }
+        return;
+    }
+    if (repeat <= 2) {
+        // four mask bytes widened to a mask of four pixels
+        const __m128i zero = _mm_setzero_si128();
+        for (unsigned x = 0; x < n; x += 4) {
+            int bytes;
+            copy_n(from + x, 4, (uint8_t *) &bytes);
+            __m128i m = _mm_cvtsi32_si128(bytes);
+            m = _mm_unpacklo_epi16(_mm_unpacklo_epi8(m, zero), zero);
+            m = _mm_cmpgt_epi32(m, zero);
+            __m128i c = _mm_or_si128(_mm_and_si128(m, vlit),
+                                     _mm_andnot_si128(m, vdark));
+            if (repeat == 1) {
+                _mm_storeu_si128((__m128i *) to, c);
+                to += 4;
+            } else {
+                _mm_storeu_si128((__m128i *) to, _mm_unpacklo_epi32(c, c));
+                _mm_storeu_si128((__m128i *) (to + 4),
+                                 _mm_unpackhi_epi32(c, c));
+                to += 8;
+            }
+        }
+        return;
+    }
+#endif
+    for (unsigned x = 0; x < n; ++x)
+        to = fill_n(to, repeat, from[x] ? lit : dark);
+}
+
+const uint32_t * raster_t::draw(const chip8::frame_t & frame) {
+    smooth(frame);
+    const unsigned w = width();
+    uint32_t * p = pixels.data();
+    for (unsigned y = 0; y < 32 * factor; ++y, p += repeat * w) {
+        const uint8_t * row = &mask[y * 64 * factor];
+        expand(row, p, on, off);
+        for (unsigned r = 1; r < repeat; ++r)
+            copy_n(p, w, p + r * w);
+        if (filter != scanline) continue;
+        // odd rows of the output at half brightness
+        if (repeat == 1) {
+            if (y % 2) expand(row, p, dim(on), dim(off));
+            continue;
+        }
+        expand(row, p + w, dim(on), dim(off));
+        for (unsigned r = 3; r < repeat; r += 2)
+            copy_n(p + w, w, p + r * w);
+    }
+    return pixels.data();
+}
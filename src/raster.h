@@ -0,0 +1,54 @@
+#pragma once
+
+#include "chip8.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+    Expands frames into scaled 32-bit pixels on the CPU, ready to upload as
+    one texture or to hand to anything that wants pixels without a GPU.
+    Colours are RGBA in memory order. The filters:
+        nearest  - each chip-8 pixel a square of scale x scale
+        scanline - nearest with every other row at half brightness
+        scale2x  - Scale2x smoothing, then nearest up to scale
+        scale3x  - Scale3x smoothing, then nearest up to scale
+    Smoothing works on whole rows of bits at once. The expansion to pixels
+    uses SSE2 where the compiler targets it and plain loops otherwise, with
+    the same result either way.
+*/
+class raster_t {
+public:
+
+    enum filter_t { nearest, scanline, scale2x, scale3x };
+
+    // Throws std::invalid_argument for an unknown name.
+    static filter_t parse(const std::string & name);
+
+    // The size is rounded down to a multiple of what the smoothing gives.
+    raster_t(filter_t filter, unsigned scale,
+             uint32_t on = 0xffcccccc, uint32_t off = 0xff000000);
+
+    unsigned width() const { return 64 * factor * repeat; }
+    unsigned height() const { return 32 * factor * repeat; }
+
+    // width() * height() pixels, row by row, valid until the next draw().
+    const uint32_t * draw(const chip8::frame_t & frame);
+
+private:
+
+    filter_t filter;
+    // pixels the smoothing makes of one, and how often each of those repeats
+    unsigned factor;
+    unsigned repeat;
+    uint32_t on;
+    uint32_t off;
+    // the smoothed image, a byte per pixel, 0 or 1
+    std::vector<uint8_t> mask;
+    std::vector<uint32_t> pixels;
+
+    void smooth(const chip8::frame_t & frame);
+    void expand(const uint8_t * from, uint32_t * to,
+                uint32_t lit, uint32_t dark) const;
+
+};
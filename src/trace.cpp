@@ -0,0 +1,113 @@
+#include "trace.h"
+#include "chip8.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char MAGIC[8] = { 'C', 'H', 'I', 'P', '8', 'T', 'R', 'C' };
+static const uint32_t VERSION = 1;
+
+struct trace_exception : runtime_error {
+    trace_exception(const string & what, const string & path)
+            : runtime_error(what + ": " + path) { }
+};
+
+trace_t::trace_t(const string & path, size_t capacity) {
+    size_t n = 1;
+    while (n < capacity) n <<= 1;
+    mask = n - 1;
+    length = sizeof(header_t) + n * sizeof(record_t);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw trace_exception("can't open trace file", path);
+    if (ftruncate(fd, length) < 0) {
+        ::close(fd);
+        throw trace_exception("can't resize trace file", path);
+    }
+    base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) throw trace_exception("can't map trace file", path);
+    head = static_cast<header_t *>(base);
+    records = reinterpret_cast<record_t *>(head + 1);
+    last = records;
+    memcpy(head->magic, MAGIC, sizeof(MAGIC));
+    head->version = VERSION;
+    head->record_size = sizeof(record_t);
+    head->capacity = n;
+    head->count = 0;
+}
+
+trace_t::~trace_t() { munmap(base, length); }
+
+// What an instruction left behind, judged by its opcode.
+static string effects(const trace_t::record_t & r) {
+    uint8_t n = r.in & 0x000f;
+    uint8_t kk = r.in & 0x00ff;
+    int x = (r.in >> 8) & 0x000f;
+    int y = (r.in >> 4) & 0x000f;
+    ostringstream s;
+    s << hex << setfill('0');
+    auto vx = [&] { s << "V" << x << "=" << setw(2) << (int) r.vx; };
+    auto vy = [&] { s << "V" << y << "=" << setw(2) << (int) r.vx; };
+    auto vf = [&] { s << "VF=" << (int) r.vf; };
+    auto i = [&] { s << "I=" << setw(4) << r.i; };
+    switch (r.in & 0xf000) {
+    case 0x2000: s << "push " << setw(4) << r.pc; break;
+    case 0x6000: case 0x7000: case 0xc000: vx(); break;
+    case 0x8000:
+        n == 0x7 ? vy() : vx();
+        if (n >= 0x4) s << " ", vf();
+        break;
+    case 0xa000: i(); break;
+    case 0xd000: vf(); break;
+    case 0xf000:
+        switch (kk) {
+        case 0x07: vx(); break;
+        case 0x1e: case 0x29: i(); break;
+        case 0x33: s << "[" << setw(4) << r.i << "]=bcd " << (int) r.vx;
+                   break;
+        case 0x55: if (x) s << "[" << setw(4) << r.i << "]=V0..V" << x - 1;
+                   break;
+        case 0x65: if (x) s << "V0..V" << x - 1 << "=[" << setw(4) << r.i
+                            << "]";
+                   break;
+        } break;
+    }
+    return s.str();
+}
+
+void trace_t::decode(const string & path, ostream & out) {
+    ifstream in(path, ios_base::in | ios_base::binary | ios_base::ate);
+    uint64_t size = max<streamoff>(in.tellg(), 0);
+    in.seekg(0);
+    header_t h;
+    if (!in.read((char *) &h, sizeof(h))
+            || memcmp(h.magic, MAGIC, sizeof(MAGIC))
+            || h.version != VERSION || h.record_size != sizeof(record_t))
+        throw trace_exception("not a trace file", path);
+    // the ring is indexed by masking, and must be in the file
+    if (!h.capacity || h.capacity & (h.capacity - 1)
+            || h.capacity > (size - sizeof(h)) / sizeof(record_t))
+        throw trace_exception("corrupt trace file", path);
+    vector<record_t> records(h.capacity);
+    if (!in.read((char *) records.data(), h.capacity * sizeof(record_t)))
+        throw trace_exception("corrupt trace file", path);
+    uint64_t first = h.count > h.capacity ? h.count - h.capacity : 0;
+    for (uint64_t k = first; k < h.count; ++k) {
+        const record_t & r = records[k & (h.capacity - 1)];
+        ostringstream line;
+        print_instruction(line, r.pc, r.in);
+        string text = line.str();
+        text.pop_back();
+        out << setw(40) << left << text << " ; " << effects(r) << "\n";
+    }
+    out << flush;
+}
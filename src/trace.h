@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+/*
+    Instruction trace kept in a memory mapped ring file. Every executed
+    instruction is one fixed size record. Its address and opcode are written
+    before it runs, so an instruction that crashes is the last record. The
+    registers it may have changed are filled in after: I, VF and the one it
+    writes, Vx or Vy for 8xy7. Memory effects follow from the opcode and I:
+    Fx33 and Fx55 write at I. Not recorded are the values Fx65 loads into
+    V0..Vx-1 and the stack slot 2nnn pushes its return address to, only
+    which registers and which address. The file is mapped shared, so
+    whatever was recorded survives the process dying.
+*/
+class trace_t {
+public:
+
+    struct record_t {
+        uint16_t pc;
+        uint16_t in;
+        uint16_t i;
+        // Vy for 8xy7
+        uint8_t vx;
+        uint8_t vf;
+    };
+
+    // capacity is in records, the file is created or truncated.
+    trace_t(const std::string & path, size_t capacity = 1 << 22);
+    trace_t(const trace_t & t) = delete;
+    trace_t & operator=(const trace_t & t) = delete;
+    ~trace_t();
+
+    // Records an instruction about to execute.
+    void begin(uint16_t pc, uint16_t in) {
+        last = &records[head->count++ & mask];
+        *last = { pc, in, 0, 0, 0 };
+    }
+
+    // Fills in what the instruction begin() recorded changed.
+    void end(uint16_t i, uint8_t vx, uint8_t vf) {
+        last->i = i;
+        last->vx = vx;
+        last->vf = vf;
+    }
+
+    // Prints the records of the trace file at path, oldest first.
+    static void decode(const std::string & path, std::ostream & out);
+
+    struct header_t {
+        char magic[8];
+        uint32_t version;
+        uint32_t record_size;
+        uint64_t capacity;
+        uint64_t count;
+    };
+
+private:
+
+    void * base;
+    size_t length;
+    header_t * head;
+    record_t * records;
+    record_t * last;
+    uint64_t mask;
+
+};
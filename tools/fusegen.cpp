@@ -0,0 +1,123 @@
+#include "harness.h"
+#include "machine.h"
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+/*
+    Runs the ROMs given on the command line headless and prints the table of
+    superinstructions machine.cpp is built with: the runs of two or three
+    instructions at consecutive addresses that were executed most often.
+*/
+
+static const char * NAMES[] = {
+#define CHIP8_OP_NAME(name) #name,
+    CHIP8_OPS(CHIP8_OP_NAME)
+#undef CHIP8_OP_NAME
+    "none"
+};
+
+// about a minute of play per ROM
+static const int FRAMES = 4000;
+static const int MAX_FUSIONS = 24;
+// superinstructions saving fewer dispatches than this aren't worth a slot
+static const double MIN_SHARE = 0.002;
+
+using sequence_t = array<op_t, 3>;
+
+struct executed_t {
+    uint16_t pc;
+    op_t op;
+};
+
+static bool same_page(uint16_t from, int length) {
+    return (from >> memory_t::PAGE_BITS)
+        == ((from + 2 * length - 1) >> memory_t::PAGE_BITS);
+}
+
+static uint64_t profile(istream & source, map<sequence_t, uint64_t> & counts) {
+    machine_t m;
+    m.load(source);
+    executed_t last[2] = { { 0, op_none }, { 0, op_none } };
+    uint64_t executed = 0;
+    try {
+        for (int frame = 0; frame < FRAMES; ++frame) {
+            m.set_keys(scripted_keys(frame));
+            const uint64_t end = m.frame_end();
+            while (true) {
+                executed_t now = { m.pc, decode(m.read_word(m.pc)) };
+                // single steps never take superinstructions
+                if (!m.step_frame(end)) break;
+                ++executed;
+                if (last[1].pc + 2 == now.pc && same_page(last[1].pc, 2))
+                    ++counts[{{ last[1].op, now.op, op_none }}];
+                if (last[1].pc + 2 == now.pc && last[0].pc + 2 == last[1].pc
+                        && same_page(last[0].pc, 3))
+                    ++counts[{{ last[0].op, last[1].op, now.op }}];
+                last[0] = last[1];
+                last[1] = now;
+            }
+        }
+    } catch (const unknown_instruction_exception & e) {
+        // the ROM crashed, keep what ran up to here
+    }
+    return executed;
+}
+
+int main(int argc, char ** argv) {
+    map<sequence_t, uint64_t> counts;
+    uint64_t total = 0;
+    for (int k = 1; k < argc; ++k) {
+        ifstream source(argv[k], ios_base::in | ios_base::binary);
+        if (!source) {
+            cerr << "error: can't open file " << argv[k] << endl;
+            return -1;
+        }
+        total += profile(source, counts);
+    }
+
+    struct candidate_t {
+        sequence_t ops;
+        int length;
+        double share;
+    };
+    vector<candidate_t> candidates;
+    for (auto & c : counts) {
+        int length = c.first[2] == op_none ? 2 : 3;
+        bool ok = true;
+        for (int l = 0; l < length; ++l)
+            ok = ok && fusible(c.first[l], l + 1 == length);
+        // a dispatch is saved for every instruction but the first
+        double share = total ? double(c.second) * (length - 1) / total : 0;
+        if (ok && share >= MIN_SHARE)
+            candidates.push_back({ c.first, length, share });
+    }
+    sort(candidates.begin(), candidates.end(),
+         [](const candidate_t & a, const candidate_t & b) {
+             return a.share > b.share;
+         });
+    if (candidates.size() > MAX_FUSIONS) candidates.resize(MAX_FUSIONS);
+    // longer sequences first, they take precedence where both match
+    stable_sort(candidates.begin(), candidates.end(),
+                [](const candidate_t & a, const candidate_t & b) {
+                    return a.length > b.length;
+                });
+
+    cout << "// Generated by fusegen from " << argc - 1 << " ROMs and "
+         << total << " instructions, do not edit.\n"
+         << "// Each line is a superinstruction and the share of dispatches"
+            " it saved.\n";
+    for (auto & c : candidates) {
+        string line = string("FUSE(") + NAMES[c.ops[0]] + ", "
+                    + NAMES[c.ops[1]] + ", " + NAMES[c.ops[2]] + ")";
+        cout << setw(40) << left << line << " // "
+             << fixed << setprecision(2) << 100 * c.share << "%\n";
+    }
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include "chip8.h"
+#include "harness.h"
+#include "machine.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+    Measures how long the ROMs given on the command line take to show a key
+    press, headless and the same on every run, under both timings. Each ROM
+    gets key presses at pseudo-random times, given to the frontend the way
+    a host does: keys set between frames, then run_frame(). At each press
+    the frontend is forked with snapshot(): one fork gets the key, the
+    other doesn't. Keys are tried from a random one on until the game
+    answers.
+
+    key-to-frame is from the press to the instruction that first drew
+    something different. A machine run alongside the frontend, on the same
+    keys, is forked too and both forks go through their frames an
+    instruction at a time with step_frame() to find it. key-to-present is
+    from the press to the end of the first frame that presented() shows
+    differently, which is what the window displays, run-ahead included.
+    Times are in milliseconds: a frame is 15 of them under legacy timing
+    and a 60th of a second under VIP timing.
+*/
+
+// long enough for games to get past their title screens
+static const int WARMUP_FRAMES = 300;
+static const int EVENTS = 200;
+// between presses, so that games settle
+static const int GAP_FRAMES = 20;
+static const int HOLD_FRAMES = 8;
+// presses nothing answers within this are counted as ignored
+static const int MAX_FRAMES = 60;
+
+struct stats_t {
+    vector<double> frame;
+    vector<double> present;
+    int ignored = 0;
+};
+
+// Frames as a host runs them, keys set before each, on the frontend and the
+// machine alongside it.
+static void run_frames(chip8 & c, machine_t & m, int frames, uint16_t keys) {
+    for (int k = 0; k < frames; ++k) {
+        c.set_keys(keys);
+        c.run_frame();
+        m.set_keys(keys);
+        m.run_frame();
+    }
+}
+
+// Cycles from the start of pressed until its screen differs from released,
+// or -1.
+static int first_draw(machine_t pressed, machine_t released, uint16_t keys) {
+    const uint64_t start = pressed.cycle;
+    for (int frame = 0; frame < MAX_FRAMES; ++frame) {
+        pressed.set_keys(frame < HOLD_FRAMES ? keys : 0);
+        released.set_keys(0);
+        const uint64_t end = pressed.frame_end();
+        bool running[2] = { true, true };
+        while (running[0] || running[1]) {
+            if (running[0]) running[0] = pressed.step_frame(end);
+            if (running[1]) running[1] = released.step_frame(end);
+            // the clock of the one still going, the other is at the end
+            if (pressed.display.frame() != released.display.frame())
+                return min(pressed.cycle, released.cycle) - start;
+        }
+    }
+    return -1;
+}
+
+// Frames run until pressed presents something released doesn't, or -1.
+static int first_present(chip8 pressed, chip8 released, uint16_t keys) {
+    for (int frame = 0; frame < MAX_FRAMES; ++frame) {
+        pressed.set_keys(frame < HOLD_FRAMES ? keys : 0);
+        released.set_keys(0);
+        pressed.run_frame();
+        released.run_frame();
+        if (pressed.presented() != released.presented()) return frame + 1;
+    }
+    return -1;
+}
+
+static stats_t measure(const string & program, bool vip, unsigned runahead) {
+    stats_t stats;
+    chip8 c;
+    machine_t m;
+    m.vip = vip;
+    istringstream source(program), copy(program);
+    m.load(source);
+    c.load(copy);
+    if (vip) c.vip_timing();
+    c.runahead(runahead);
+    const int frame_time = m.frame_cycles();
+    const double ms = (vip ? 1000.0 / 60 : machine_t::STEPS_PER_FRAME)
+                    / frame_time;
+    uint32_t seed = 2463534242;
+    try {
+        for (int frame = 0; frame < WARMUP_FRAMES; ++frame)
+            run_frames(c, m, 1, scripted_keys(frame));
+        for (int event = 0; event < EVENTS; ++event) {
+            run_frames(c, m, GAP_FRAMES + xorshift(seed) % GAP_FRAMES, 0);
+            // the press came during the frame before, the frontend only
+            // looks at input between frames
+            int waited = 1 + xorshift(seed) % frame_time;
+            // like a player, press a key the game answers to, if any
+            int key = xorshift(seed) % 16;
+            uint16_t keys = 0;
+            int cycles = -1, frames = -1;
+            for (int k = 0; k < 16 && frames < 0; ++k) {
+                keys = 1 << (key + k) % 16;
+                cycles = first_draw(m, m, keys);
+                if (cycles >= 0)
+                    frames = first_present(c.snapshot(), c.snapshot(), keys);
+            }
+            if (frames < 0) {
+                ++stats.ignored;
+            } else {
+                stats.frame.push_back((waited + cycles) * ms);
+                stats.present.push_back((waited + frames * frame_time) * ms);
+            }
+            run_frames(c, m, HOLD_FRAMES, keys);
+        }
+    } catch (const unknown_instruction_exception & e) {
+        // the ROM crashed, keep what was measured up to here
+    }
+    return stats;
+}
+
+static double percentile(vector<double> values, int p) {
+    if (values.empty()) return 0;
+    sort(values.begin(), values.end());
+    size_t rank = (values.size() * p + 99) / 100;
+    return values[max<size_t>(rank, 1) - 1];
+}
+
+int main(int argc, char ** argv) {
+    unsigned runahead = 0;
+    int first = 1;
+    if (argc > 2 && !strcmp(argv[1], "-a")) {
+        runahead = stoul(argv[2]);
+        first = 3;
+    }
+    if (first >= argc) {
+        cout << argv[0] << " [-a <frames>] <program file>..." << endl;
+        return 0;
+    }
+    cout << left << setw(12) << "rom" << setw(8) << "timing" << right
+         << setw(8) << "presses" << setw(8) << "ignored"
+         << setw(12) << "frame p50" << setw(7) << "p99"
+         << setw(14) << "present p50" << setw(7) << "p99" << endl;
+    cout << fixed << setprecision(1);
+    for (int k = first; k < argc; ++k) {
+        ifstream source(argv[k], ios_base::in | ios_base::binary);
+        if (!source) {
+            cerr << "error: can't open file " << argv[k] << endl;
+            return -1;
+        }
+        string program((istreambuf_iterator<char>(source)),
+                       istreambuf_iterator<char>());
+        string name = argv[k];
+        name = name.substr(name.find_last_of('/') + 1);
+        for (bool vip : { false, true }) {
+            stats_t s = measure(program, vip, runahead);
+            cout << left << setw(12) << name
+                 << setw(8) << (vip ? "vip" : "legacy") << right
+                 << setw(8) << s.frame.size() + s.ignored
+                 << setw(8) << s.ignored
+                 << setw(12) << percentile(s.frame, 50)
+                 << setw(7) << percentile(s.frame, 99)
+                 << setw(14) << percentile(s.present, 50)
+                 << setw(7) << percentile(s.present, 99) << endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "harness.h"
+#include "machine.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+    Checks that machines loading the same program share its memory. For
+    each ROM given on the command line, many instances load it and have to
+    start with no page of their own; each then plays with its own keys,
+    and must end up owning no more than the pages it wrote, within a fixed
+    budget. A snapshot of one shares every page again. Prints the first
+    instance over and fails if any.
+*/
+
+static const int INSTANCES = 256;
+static const int FRAMES = 600;
+// Of memory_t::PAGES. The ROMs in games/ write a stack page and a few of
+// data, BLINKY the most at 7.
+static const int BUDGET = 8;
+
+// Why program failed, or empty.
+static string check(const string & program) {
+    vector<machine_t> machines(INSTANCES);
+    for (auto & m : machines) {
+        istringstream source(program);
+        m.load(source);
+        if (m.memory.private_pages())
+            return "owns pages after loading";
+    }
+    vector<bool> crashed(INSTANCES);
+    for (int frame = 0; frame < FRAMES; ++frame)
+        for (int k = 0; k < INSTANCES; ++k) {
+            if (crashed[k]) continue;
+            // each instance a frame further into the script, so they
+            // write different things
+            machine_t & m = machines[k];
+            m.set_keys(scripted_keys(frame + k));
+            try {
+                m.run_frame();
+            } catch (const unknown_instruction_exception & e) {
+                crashed[k] = true;
+            }
+            int pages = m.memory.private_pages();
+            if (pages > BUDGET)
+                return "instance " + to_string(k) + " owns "
+                     + to_string(pages) + " pages at frame "
+                     + to_string(frame);
+        }
+    for (auto & m : machines) {
+        machine_t snapshot = m;
+        if (snapshot.memory.private_pages() || m.memory.private_pages())
+            return "a snapshot owns pages";
+    }
+    return "";
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        cout << argv[0] << " <program file>..." << endl;
+        return 0;
+    }
+    int failed = 0;
+    for (int k = 1; k < argc; ++k) {
+        ifstream source(argv[k], ios_base::in | ios_base::binary);
+        if (!source) {
+            cerr << "error: can't open file " << argv[k] << endl;
+            return -1;
+        }
+        string program((istreambuf_iterator<char>(source)),
+                       istreambuf_iterator<char>());
+        string error = check(program);
+        if (!error.empty()) {
+            cout << argv[k] << ": " << error << endl;
+            ++failed;
+        }
+    }
+    cout << (failed ? "FAILED" : "ok") << endl;
+    return failed ? 1 : 0;
+}
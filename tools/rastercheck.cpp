@@ -0,0 +1,137 @@
+#include "machine.h"
+#include "raster.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+/*
+    Checks raster_t against a plain per pixel version of every filter, at
+    scales taking each path and on frames from empty to full. The build
+    links it twice, with raster.cpp compiled for SSE2 and without, so both
+    expansions are held to the same pixels. Prints the first difference
+    and fails if any.
+*/
+
+static const int FRAMES = 10;
+// repeats of 1, 2, 3 and more than 4 for every smoothing factor, whole
+// vectors and not
+static const unsigned SCALES[] = { 1, 2, 3, 4, 5, 6, 9, 10 };
+
+static uint64_t random64(uint32_t & seed) {
+    uint64_t high = xorshift(seed);
+    return high << 32 | xorshift(seed);
+}
+
+static int pixel(const chip8::frame_t & frame, int x, int y) {
+    // the edges repeat themselves
+    x = max(0, min(63, x));
+    y = max(0, min(31, y));
+    return (frame[y] >> (63 - x)) & 1;
+}
+
+// Scale2x and Scale3x of the pixel at x, y, as in the reference, factor
+// by factor values row by row; one value for no smoothing.
+static vector<int> smooth(const chip8::frame_t & frame, int factor,
+                          int x, int y) {
+    int a = pixel(frame, x - 1, y - 1), b = pixel(frame, x, y - 1);
+    int c = pixel(frame, x + 1, y - 1), d = pixel(frame, x - 1, y);
+    int e = pixel(frame, x, y), f = pixel(frame, x + 1, y);
+    int g = pixel(frame, x - 1, y + 1), h = pixel(frame, x, y + 1);
+    int i = pixel(frame, x + 1, y + 1);
+    vector<int> out(factor * factor, e);
+    if (factor == 1 || b == h || d == f) return out;
+    if (factor == 2) {
+        out[0] = d == b ? d : e;
+        out[1] = b == f ? f : e;
+        out[2] = d == h ? d : e;
+        out[3] = h == f ? f : e;
+        return out;
+    }
+    out[0] = d == b ? d : e;
+    out[1] = (d == b && e != c) || (b == f && e != a) ? b : e;
+    out[2] = b == f ? f : e;
+    out[3] = (d == b && e != g) || (d == h && e != a) ? d : e;
+    out[5] = (b == f && e != i) || (h == f && e != c) ? f : e;
+    out[6] = d == h ? d : e;
+    out[7] = (d == h && e != i) || (h == f && e != g) ? h : e;
+    out[8] = h == f ? f : e;
+    return out;
+}
+
+static uint32_t dim(uint32_t c) {
+    return ((c >> 1) & 0x007f7f7f) | (c & 0xff000000);
+}
+
+static vector<uint32_t> reference(const chip8::frame_t & frame,
+                                  raster_t::filter_t filter, unsigned scale,
+                                  uint32_t on, uint32_t off) {
+    int factor = filter == raster_t::scale2x ? 2
+               : filter == raster_t::scale3x ? 3 : 1;
+    unsigned repeat = max(1u, scale / factor);
+    const unsigned w = 64 * factor;
+    vector<int> mask(w * 32 * factor);
+    for (int y = 0; y < 32; ++y)
+        for (int x = 0; x < 64; ++x) {
+            vector<int> s = smooth(frame, factor, x, y);
+            for (int k = 0; k < factor * factor; ++k)
+                mask[(y * factor + k / factor) * w + x * factor + k % factor]
+                    = s[k];
+        }
+    const unsigned width = w * repeat, height = 32 * factor * repeat;
+    vector<uint32_t> out(width * height);
+    for (unsigned y = 0; y < height; ++y) {
+        // every other row of each pixel, or of the screen unscaled
+        bool dark = filter == raster_t::scanline
+                 && (repeat == 1 ? y % 2 : y % repeat % 2);
+        for (unsigned x = 0; x < width; ++x) {
+            uint32_t c = mask[y / repeat * w + x / repeat] ? on : off;
+            out[y * width + x] = dark ? dim(c) : c;
+        }
+    }
+    return out;
+}
+
+int main() {
+    uint32_t seed = 2463534242;
+    int failed = 0;
+    for (int n = 0; n < FRAMES && !failed; ++n) {
+        // empty, full, then from sparse like sprites to dense
+        chip8::frame_t frame;
+        for (auto & row : frame) {
+            uint64_t a = random64(seed), b = random64(seed);
+            row = n == 0 ? 0 : n == 1 ? ~uint64_t(0)
+                : n % 3 == 0 ? a & b & random64(seed)
+                : n % 3 == 1 ? a : a | b;
+        }
+        uint32_t on = n % 2 ? 0xffcccccc : xorshift(seed);
+        uint32_t off = n % 2 ? 0xff000000 : xorshift(seed);
+        for (auto filter : { raster_t::nearest, raster_t::scanline,
+                             raster_t::scale2x, raster_t::scale3x })
+            for (unsigned scale : SCALES) {
+                raster_t r(filter, scale, on, off);
+                vector<uint32_t> want = reference(frame, filter, scale,
+                                                  on, off);
+                const uint32_t * got = r.draw(frame);
+                if (want.size() != r.width() * r.height()) {
+                    cout << "frame " << n << ", filter " << filter
+                         << ", scale " << scale << ": size "
+                         << r.width() << "x" << r.height() << endl;
+                    ++failed;
+                    continue;
+                }
+                auto diff = mismatch(want.begin(), want.end(), got);
+                if (diff.first == want.end()) continue;
+                size_t at = diff.first - want.begin();
+                cout << "frame " << n << ", filter " << filter
+                     << ", scale " << scale << ": pixel "
+                     << at % r.width() << "," << at / r.width() << hex
+                     << " is " << *diff.second << ", not " << *diff.first
+                     << dec << endl;
+                ++failed;
+            }
+    }
+    cout << (failed ? "FAILED" : "ok") << endl;
+    return failed ? 1 : 0;
+}
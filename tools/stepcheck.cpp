@@ -0,0 +1,141 @@
+#include "harness.h"
+#include "machine.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+/*
+    Checks that how a host slices execution doesn't change it. For each ROM
+    given on the command line, under both timings, one machine runs batches
+    of instructions of varying size while another runs the same number one
+    at a time, with the same keys. Their whole state must agree after every
+    batch: a batch running over a frame end has to tick the timers there,
+    as single steps do. Likewise whole frames must agree with frames gone
+    through by step_frame(), which the other tools use. Prints the first
+    difference and fails if any.
+*/
+
+static const int BATCHES = 3000;
+static const int FRAMES = 3000;
+// Not a divisor of a frame, so batches end anywhere in one.
+static const int MAX_BATCH = 97;
+
+static bool same(const machine_t & a, const machine_t & b) {
+    for (int addr = 0; addr < 4096; ++addr)
+        if (a.read_byte(addr) != b.read_byte(addr)) return false;
+    return a.display.frame() == b.display.frame() && a.v == b.v
+        && a.i == b.i && a.pc == b.pc && a.sp == b.sp
+        && a.delay() == b.delay() && a.sound() == b.sound()
+        && a.keys == b.keys && a.wait_for_key == b.wait_for_key
+        && a.seed == b.seed && a.cycle == b.cycle && a.vblank == b.vblank;
+}
+
+// The batch the first difference showed up in, or -1.
+static int compare(const string & program, bool vip) {
+    machine_t batched;
+    batched.vip = vip;
+    istringstream source(program);
+    batched.load(source);
+    machine_t stepped = batched;
+    uint32_t seed = 2463534242;
+    for (int batch = 0; batch < BATCHES; ++batch) {
+        // about a batch a frame
+        uint16_t keys = scripted_keys(batch / 2);
+        batched.set_keys(keys);
+        stepped.set_keys(keys);
+        int n = 1 + xorshift(seed) % MAX_BATCH;
+        bool crashed[2] = { false, false };
+        try {
+            batched.run(n);
+        } catch (const unknown_instruction_exception & e) {
+            crashed[0] = true;
+        }
+        try {
+            for (int k = 0; k < n; ++k)
+                stepped.run(1);
+        } catch (const unknown_instruction_exception & e) {
+            crashed[1] = true;
+        }
+        // a crashed machine is only good for where it stopped
+        if (crashed[0] || crashed[1])
+            return crashed[0] == crashed[1] && batched.pc == stepped.pc
+                 ? -1 : batch;
+        if (!same(batched, stepped)) return batch;
+        // let a wait for a key pass, as the frontend does
+        if (batched.wait_for_key) {
+            batched.run_frame();
+            stepped.run_frame();
+        }
+    }
+    return -1;
+}
+
+// The frame the first difference showed up in, or -1.
+static int compare_frames(const string & program, bool vip) {
+    machine_t framed;
+    framed.vip = vip;
+    istringstream source(program);
+    framed.load(source);
+    machine_t stepped = framed;
+    for (int frame = 0; frame < FRAMES; ++frame) {
+        framed.set_keys(scripted_keys(frame));
+        stepped.set_keys(scripted_keys(frame));
+        bool crashed[2] = { false, false };
+        try {
+            framed.run_frame();
+        } catch (const unknown_instruction_exception & e) {
+            crashed[0] = true;
+        }
+        try {
+            const uint64_t end = stepped.frame_end();
+            while (stepped.step_frame(end)) { }
+        } catch (const unknown_instruction_exception & e) {
+            crashed[1] = true;
+        }
+        if (crashed[0] || crashed[1])
+            return crashed[0] == crashed[1] && framed.pc == stepped.pc
+                 ? -1 : frame;
+        if (!same(framed, stepped)) return frame;
+    }
+    return -1;
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        cout << argv[0] << " <program file>..." << endl;
+        return 0;
+    }
+    int failed = 0;
+    for (int k = 1; k < argc; ++k) {
+        ifstream source(argv[k], ios_base::in | ios_base::binary);
+        if (!source) {
+            cerr << "error: can't open file " << argv[k] << endl;
+            return -1;
+        }
+        string program((istreambuf_iterator<char>(source)),
+                       istreambuf_iterator<char>());
+        for (bool vip : { false, true }) {
+            const char * timing = vip ? " (vip)" : "";
+            int batch = compare(program, vip);
+            if (batch >= 0) {
+                cout << argv[k] << timing
+                     << ": batched and single steps differ after batch "
+                     << batch << endl;
+                ++failed;
+            }
+            int frame = compare_frames(program, vip);
+            if (frame >= 0) {
+                cout << argv[k] << timing
+                     << ": whole and stepped frames differ after frame "
+                     << frame << endl;
+                ++failed;
+            }
+        }
+    }
+    cout << (failed ? "FAILED" : "ok") << endl;
+    return failed ? 1 : 0;
+}